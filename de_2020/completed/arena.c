@@ -0,0 +1,46 @@
+/* Arena: bump allocation freed all at once */
+
+#include <stdlib.h>
+#include "arena.h"
+
+struct ArenaBlock_ {
+  struct ArenaBlock_ *next;
+  double data[1];               // start of the usable space, suitably aligned
+};
+
+typedef struct ArenaBlock_ ArenaBlock;
+
+Arena* createArena(void) {
+  Arena* arena = (Arena*) malloc(sizeof(Arena));
+  arena->blocks = NULL;
+  arena->next = NULL;
+  arena->limit = NULL;
+  return arena;
+}
+
+void freeArena(Arena* arena) {
+  ArenaBlock* block = arena->blocks;
+  while (block != NULL) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  free(arena);
+}
+
+void* arenaAlloc(Arena* arena, int size) {
+  char* p;
+
+  size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  if (arena->limit - arena->next < size) {
+    int blockSize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+    ArenaBlock* block = (ArenaBlock*) malloc(sizeof(ArenaBlock) + blockSize);
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->next = (char*) block->data;
+    arena->limit = arena->next + blockSize;
+  }
+  p = arena->next;
+  arena->next += size;
+  return p;
+}
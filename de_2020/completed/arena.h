@@ -0,0 +1,26 @@
+/* Arena: bump allocation freed all at once */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+// A bump allocator. Nothing allocated from an arena is freed on its own;
+// the whole arena is released at once by freeArena.
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 8
+
+struct ArenaBlock_;
+
+struct Arena_ {
+  struct ArenaBlock_ *blocks;
+  char* next;
+  char* limit;
+};
+
+typedef struct Arena_ Arena;
+
+Arena* createArena(void);
+void freeArena(Arena* arena);
+void* arenaAlloc(Arena* arena, int size);
+
+#endif
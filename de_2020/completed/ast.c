@@ -0,0 +1,179 @@
+/* Abstract syntax tree */
+
+#include <stdlib.h>
+#include <string.h>
+#include "state.h"
+#include "arena.h"
+#include "ast.h"
+
+extern COMPILER_STATE Arena* compileArena;
+
+LValue* makeLValue(Object* object, Expression* indexes, Type* type) {
+  LValue* lvalue = (LValue*) arenaAlloc(compileArena, sizeof(LValue));
+  lvalue->object = object;
+  lvalue->indexes = indexes;
+  lvalue->address = NULL;
+  lvalue->type = type;
+  return lvalue;
+}
+
+LValue* makeAddressLValue(Expression* address, Type* type) {
+  LValue* lvalue = makeLValue(NULL, NULL, type);
+  lvalue->address = address;
+  return lvalue;
+}
+
+/******************* Expressions ******************************/
+
+Expression* makeExpression(enum ExpressionKind kind, Type* type) {
+  Expression* exp = (Expression*) arenaAlloc(compileArena, sizeof(Expression));
+  exp->kind = kind;
+  exp->type = type;
+  exp->next = NULL;
+  return exp;
+}
+
+Expression* makeConstantExpression(WORD value, Type* type) {
+  Expression* exp = makeExpression(EXP_CONSTANT, type);
+  exp->value = value;
+  return exp;
+}
+
+Expression* makeVariableExpression(LValue* lvalue) {
+  Expression* exp = makeExpression(EXP_VARIABLE, lvalue->type);
+  exp->lvalue = lvalue;
+  return exp;
+}
+
+Expression* makeReferenceExpression(LValue* lvalue) {
+  Expression* exp = makeExpression(EXP_REFERENCE, lvalue->type);
+  exp->lvalue = lvalue;
+  return exp;
+}
+
+Expression* makeCallExpression(Object* function, Expression* arguments) {
+  Expression* exp = makeExpression(EXP_CALL, function->funcAttrs.returnType);
+  exp->call.function = function;
+  exp->call.arguments = arguments;
+  return exp;
+}
+
+Expression* makeNegateExpression(Expression* operand) {
+  Expression* exp = makeExpression(EXP_NEGATE, operand->type);
+  exp->operand = operand;
+  return exp;
+}
+
+// The type of an arithmetic expression is that of its left operand; a
+// comparison is typed by its operands too, as the VM has no booleans
+Expression* makeBinaryExpression(TokenType op, Expression* left, Expression* right) {
+  Expression* exp = makeExpression(EXP_BINARY, left->type);
+  exp->binary.op = op;
+  exp->binary.left = left;
+  exp->binary.right = right;
+  return exp;
+}
+
+Expression* makeSaveExpression(Object* temp, Expression* operand) {
+  Expression* exp = makeExpression(EXP_SAVE, operand->type);
+  exp->save.temp = temp;
+  exp->save.operand = operand;
+  return exp;
+}
+
+Expression* makeInlineExpression(Statement* body, Expression* value, int pure) {
+  Expression* exp = makeExpression(EXP_INLINE, value->type);
+  exp->inlined.body = body;
+  exp->inlined.value = value;
+  exp->inlined.pure = pure;
+  return exp;
+}
+
+/******************* Operator chains ******************************/
+
+void openChain(Chain* chain, Expression* exp) {
+  int capacity = CHAIN_SPACE;
+
+  chain->nodes = chain->space;
+  chain->count = 0;
+  for (; exp->kind == EXP_BINARY; exp = exp->binary.left) {
+    if (chain->count == capacity) {
+      capacity *= 2;
+      if (chain->nodes == chain->space) {
+	chain->nodes = (Expression**) malloc(capacity * sizeof(Expression*));
+	memcpy(chain->nodes, chain->space, sizeof(chain->space));
+      } else chain->nodes = (Expression**) realloc(chain->nodes, capacity * sizeof(Expression*));
+    }
+    chain->nodes[chain->count ++] = exp;
+  }
+}
+
+void closeChain(Chain* chain) {
+  if (chain->nodes != chain->space)
+    free(chain->nodes);
+}
+
+/******************* Statements ******************************/
+
+Statement* makeStatement(enum StatementKind kind) {
+  Statement* st = (Statement*) arenaAlloc(compileArena, sizeof(Statement));
+  st->kind = kind;
+  st->next = NULL;
+  return st;
+}
+
+Statement* makeAssignStatement(LValue* lvalue, Expression* value) {
+  Statement* st = makeStatement(ST_ASSIGN);
+  st->assign.lvalue = lvalue;
+  st->assign.value = value;
+  return st;
+}
+
+Statement* makeCallStatement(Object* procedure, Expression* arguments) {
+  Statement* st = makeStatement(ST_CALL);
+  st->call.procedure = procedure;
+  st->call.arguments = arguments;
+  return st;
+}
+
+Statement* makeGroupStatement(Statement* body) {
+  Statement* st = makeStatement(ST_GROUP);
+  st->body = body;
+  return st;
+}
+
+Statement* makeIfStatement(Expression* condition, Statement* thenPart, Statement* elsePart) {
+  Statement* st = makeStatement(ST_IF);
+  st->ifSt.condition = condition;
+  st->ifSt.thenPart = thenPart;
+  st->ifSt.elsePart = elsePart;
+  return st;
+}
+
+Statement* makeWhileStatement(Expression* condition, Statement* body) {
+  Statement* st = makeStatement(ST_WHILE);
+  st->whileSt.condition = condition;
+  st->whileSt.body = body;
+  return st;
+}
+
+Statement* makeForStatement(LValue* variable, Expression* from, Expression* to, Statement* body) {
+  Statement* st = makeStatement(ST_FOR);
+  st->forSt.variable = variable;
+  st->forSt.from = from;
+  st->forSt.to = to;
+  st->forSt.body = body;
+  return st;
+}
+
+/******************* Blocks ******************************/
+
+Block* makeBlock(Object* owner, Scope* scope) {
+  Block* block = (Block*) arenaAlloc(compileArena, sizeof(Block));
+  block->owner = owner;
+  block->scope = scope;
+  block->subBlocks = NULL;
+  block->body = NULL;
+  block->next = NULL;
+  return block;
+}
@@ -0,0 +1,165 @@
+/* Abstract syntax tree */
+
+#ifndef __AST_H__
+#define __AST_H__
+
+#include "token.h"
+#include "symtab.h"
+
+// The parser checks a program and builds its tree; the code generator
+// lowers the tree to VM code. Every node comes from the compile arena and
+// every expression carries the type the parser gave it.
+
+enum ExpressionKind {
+  EXP_CONSTANT,     // an integer or character constant
+  EXP_VARIABLE,     // the value of an lvalue
+  EXP_REFERENCE,    // the address of an lvalue, passed for a VAR parameter
+  EXP_CALL,         // a function call
+  EXP_NEGATE,       // - operand
+  EXP_BINARY,       // left op right, op is an operator token
+  EXP_SAVE,         // the value of operand, also kept in a temporary
+  EXP_INLINE        // the value of an expression read after running a
+                    //   statement: an inlined function call
+};
+
+enum StatementKind {
+  ST_ASSIGN,
+  ST_CALL,
+  ST_GROUP,
+  ST_IF,
+  ST_WHILE,
+  ST_FOR
+};
+
+struct Expression_;
+struct Statement_;
+
+// A variable, possibly subscripted, a parameter, or the return value of
+// the function being defined. The optimizer may also make it the word at
+// an address it has computed; object is NULL then.
+struct LValue_ {
+  Object* object;
+  struct Expression_ *indexes;  // subscripts, linked by next
+  struct Expression_ *address;  // if object is NULL
+  Type* type;
+};
+
+typedef struct LValue_ LValue;
+
+struct Expression_ {
+  enum ExpressionKind kind;
+  Type* type;
+  union {
+    WORD value;                         // EXP_CONSTANT
+    LValue* lvalue;                     // EXP_VARIABLE, EXP_REFERENCE
+    struct {
+      Object* function;
+      struct Expression_ *arguments;    // linked by next
+    } call;                             // EXP_CALL
+    struct Expression_ *operand;        // EXP_NEGATE
+    struct {
+      TokenType op;
+      struct Expression_ *left;
+      struct Expression_ *right;
+    } binary;                           // EXP_BINARY
+    struct {
+      Object* temp;
+      struct Expression_ *operand;
+    } save;                             // EXP_SAVE
+    struct {
+      struct Statement_ *body;          // has no loops
+      struct Expression_ *value;
+      int pure;                         // the body only sets temporaries of its own
+    } inlined;                          // EXP_INLINE
+  };
+  struct Expression_ *next;             // next subscript or argument
+};
+
+typedef struct Expression_ Expression;
+
+struct Statement_ {
+  enum StatementKind kind;
+  union {
+    struct {
+      LValue* lvalue;
+      Expression* value;
+    } assign;                           // ST_ASSIGN
+    struct {
+      Object* procedure;
+      Expression* arguments;
+    } call;                             // ST_CALL
+    struct Statement_ *body;            // ST_GROUP
+    struct {
+      Expression* condition;
+      struct Statement_ *thenPart;      // NULL if empty
+      struct Statement_ *elsePart;      // NULL if empty or missing
+    } ifSt;                             // ST_IF
+    struct {
+      Expression* condition;
+      struct Statement_ *body;
+    } whileSt;                          // ST_WHILE
+    struct {
+      LValue* variable;
+      Expression* from;
+      Expression* to;
+      struct Statement_ *body;
+    } forSt;                            // ST_FOR
+  };
+  struct Statement_ *next;              // next statement of a group
+};
+
+typedef struct Statement_ Statement;
+
+// The program or a subprogram: the subprograms declared in it, then its body
+struct Block_ {
+  Object* owner;
+  Scope* scope;
+  struct Block_ *subBlocks;             // linked by next, in declaration order
+  Statement* body;
+  struct Block_ *next;
+};
+
+typedef struct Block_ Block;
+
+// Sums and terms are parsed into chains that grow to the left, one binary
+// node per operator, so a walker making a call per node would need a stack
+// as deep as the longest expression. Walkers follow such a chain with a
+// loop over a Chain instead: its binary nodes from the top down, the first
+// operand being nodes[count - 1]->binary.left. Short chains are kept in
+// space, longer ones in a buffer that closeChain frees.
+
+#define CHAIN_SPACE 8
+
+struct Chain_ {
+  Expression** nodes;
+  int count;
+  Expression* space[CHAIN_SPACE];
+};
+
+typedef struct Chain_ Chain;
+
+void openChain(Chain* chain, Expression* exp);
+void closeChain(Chain* chain);
+
+LValue* makeLValue(Object* object, Expression* indexes, Type* type);
+LValue* makeAddressLValue(Expression* address, Type* type);
+
+Expression* makeConstantExpression(WORD value, Type* type);
+Expression* makeVariableExpression(LValue* lvalue);
+Expression* makeReferenceExpression(LValue* lvalue);
+Expression* makeCallExpression(Object* function, Expression* arguments);
+Expression* makeNegateExpression(Expression* operand);
+Expression* makeBinaryExpression(TokenType op, Expression* left, Expression* right);
+Expression* makeSaveExpression(Object* temp, Expression* operand);
+Expression* makeInlineExpression(Statement* body, Expression* value, int pure);
+
+Statement* makeAssignStatement(LValue* lvalue, Expression* value);
+Statement* makeCallStatement(Object* procedure, Expression* arguments);
+Statement* makeGroupStatement(Statement* body);
+Statement* makeIfStatement(Expression* condition, Statement* thenPart, Statement* elsePart);
+Statement* makeWhileStatement(Expression* condition, Statement* body);
+Statement* makeForStatement(LValue* variable, Expression* from, Expression* to, Statement* body);
+
+Block* makeBlock(Object* owner, Scope* scope);
+
+#endif
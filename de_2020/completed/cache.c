@@ -0,0 +1,159 @@
+/* Executable cache keyed on the source and options */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+  #include <direct.h>
+  #include <process.h>
+  #define makeDirectory(name) _mkdir(name)
+#else
+  #include <unistd.h>
+  #define makeDirectory(name) mkdir((name), 0777)
+#endif
+#include "state.h"
+#include "reader.h"
+#include "optimize.h"
+#include "cache.h"
+
+// Counts the executables stored by this thread; with the thread-local's
+// address it makes temporary names unique across threads
+COMPILER_STATE int storeCount = 0;
+
+/******************* Keys ******************************/
+
+// A key is a 64-bit FNV-1a hash of the compiler version, the options that
+// affect code generation and the source, followed by the source length
+
+unsigned long long hashBytes(unsigned long long hash, char *bytes, int length) {
+  int i;
+  for (i = 0; i < length; i ++) {
+    hash ^= (unsigned char) bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void sourceKey(char *source, int length, CompileOptions* options, char *key) {
+  unsigned long long hash = 14695981039346656037ULL;
+  int level;
+
+  hash = hashBytes(hash, (char*) COMPILER_VERSION, sizeof(COMPILER_VERSION));
+  level = (options != NULL) ? options->optimizeLevel : DEFAULT_OPTIMIZE_LEVEL;
+  hash = hashBytes(hash, (char*) &level, sizeof(level));
+  hash = hashBytes(hash, source, length);
+
+  sprintf(key, "%08x%08x-%x", (unsigned int) (hash >> 32), (unsigned int) hash, length);
+}
+
+// Reads fileName and computes its key. Returns the source that was
+// hashed, for the caller to compile with compileSource and then free, so
+// that what is stored under the key is built from those very bytes even
+// if the file changes meanwhile. Returns NULL if it cannot be read.
+char* fileKey(char *fileName, CompileOptions* options, char *key, int *length) {
+  char *source = readInputFile(fileName, length);
+
+  if (source != NULL)
+    sourceKey(source, *length, options, key);
+  return source;
+}
+
+/******************* Cache directory ******************************/
+
+// The directory named by $KPL_CACHE; failing that, if one is required,
+// $HOME/.cache/kpl
+char* defaultCacheDirectory(int required) {
+  static char userCache[1024];
+  char *dir = getenv(CACHE_ENVIRONMENT);
+  char *home;
+
+  if ((dir != NULL) && (dir[0] != '\0'))
+    return dir;
+  if (!required)
+    return NULL;
+  home = getenv("HOME");
+  if ((home == NULL) || (strlen(home) + 12 >= sizeof(userCache)))
+    return (char*) ".kplcache";
+  sprintf(userCache, "%s/.cache/kpl", home);
+  return userCache;
+}
+
+// Creates dirName and any missing parent
+void makeDirectories(char *dirName) {
+  char *path = strdup(dirName);
+  char *p;
+
+  for (p = path + 1; *p != '\0'; p ++)
+    if (*p == '/') {
+      *p = '\0';
+      makeDirectory(path);
+      *p = '/';
+    }
+  makeDirectory(path);
+  free(path);
+}
+
+// The path of the executable cached under key (malloc'ed)
+char* cachedExecutable(char *cacheDir, char *key) {
+  char *path = (char*) malloc(strlen(cacheDir) + strlen(key) + 2);
+  sprintf(path, "%s/%s", cacheDir, key);
+  return path;
+}
+
+int copyFile(char *from, char *to) {
+  FILE *in, *out;
+  char buffer[4096];
+  size_t n;
+  int status = IO_SUCCESS;
+
+  in = fopen(from, "rb");
+  if (in == NULL) return IO_ERROR;
+  out = fopen(to, "wb");
+  if (out == NULL) {
+    fclose(in);
+    return IO_ERROR;
+  }
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    if (fwrite(buffer, 1, n, out) != n) {
+      status = IO_ERROR;
+      break;
+    }
+  fclose(in);
+  if (fclose(out) != 0) status = IO_ERROR;
+  return status;
+}
+
+// Copies the executable cached under key to output. Returns IO_ERROR if
+// there is none. The cached file is copied rather than linked, because
+// kplc rewrites an existing output in place, which would write through a
+// link into the cache.
+int fetchCached(char *cacheDir, char *key, char *output) {
+  char *path = cachedExecutable(cacheDir, key);
+  int status = copyFile(path, output);
+
+  free(path);
+  return status;
+}
+
+// Saves code under key. It is written to a temporary file and renamed
+// into place, so concurrent compilers never see a partial executable.
+int storeCached(char *cacheDir, char *key, CodeBlock* code) {
+  char *path = cachedExecutable(cacheDir, key);
+  char *temp = (char*) malloc(strlen(path) + 64);
+  FILE *f;
+  int status = IO_ERROR;
+
+  makeDirectories(cacheDir);
+  sprintf(temp, "%s.%d.%p.%d.tmp", path, (int) getpid(), (void*) &storeCount, storeCount ++);
+  f = fopen(temp, "wb");
+  if (f != NULL) {
+    saveCode(code, f);
+    if ((fclose(f) == 0) && (rename(temp, path) == 0))
+      status = IO_SUCCESS;
+    else remove(temp);
+  }
+  free(temp);
+  free(path);
+  return status;
+}
@@ -0,0 +1,25 @@
+/* Executable cache keyed on the source and options */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "parser.h"
+
+// Compiled executables are kept in a cache directory under a key computed
+// from the source, the compiler version and the options that affect the
+// generated code. Bump COMPILER_VERSION whenever the code generated for
+// some program may change, so that stale executables are never reused.
+
+#define COMPILER_VERSION "kplc-2020.9"
+#define CACHE_KEY_LENGTH 32
+#define CACHE_ENVIRONMENT "KPL_CACHE"
+
+void sourceKey(char *source, int length, CompileOptions* options, char *key);
+char* fileKey(char *fileName, CompileOptions* options, char *key, int *length);
+
+char* defaultCacheDirectory(int required);
+char* cachedExecutable(char *cacheDir, char *key);
+int fetchCached(char *cacheDir, char *key, char *output);
+int storeCached(char *cacheDir, char *key, CodeBlock* code);
+
+#endif
@@ -29,4 +29,8 @@ typedef enum {
   CHAR_UNKNOWN
 } CharCode;
 
+// Upper-cases a letter; digits sort below 'a' and pass through unchanged.
+// Only valid for characters of an identifier.
+#define TO_UPPER(c) (((c) >= 'a') ? ((c) - 'a' + 'A') : (c))
+
 #endif
@@ -0,0 +1,182 @@
+/* Bulk character classification */
+
+#include "charcode.h"
+#include "charscan.h"
+
+#if !defined(NO_SIMD) && defined(__GNUC__) && (__GNUC__ >= 5) && (defined(__x86_64__) || defined(__i386__))
+  #define CHARSCAN_SIMD 1
+  #include <immintrin.h>
+#else
+  #define CHARSCAN_SIMD 0
+#endif
+
+extern CharCode charCodes[];
+
+#define CODE(buffer, i) (charCodes[(unsigned char) (buffer)[i]])
+
+/******************* Scalar versions ******************************/
+
+int spanBlankScalar(char* buffer, int from, int length) {
+  while ((from < length) && (CODE(buffer, from) == CHAR_SPACE))
+    from ++;
+  return from;
+}
+
+int spanIdentScalar(char* buffer, int from, int length) {
+  while ((from < length) && 
+	 ((CODE(buffer, from) == CHAR_LETTER) || (CODE(buffer, from) == CHAR_DIGIT)))
+    from ++;
+  return from;
+}
+
+int spanDigitsScalar(char* buffer, int from, int length) {
+  while ((from < length) && (CODE(buffer, from) == CHAR_DIGIT))
+    from ++;
+  return from;
+}
+
+int findCommentEndScalar(char* buffer, int from, int length) {
+  while (from + 1 < length) {
+    if ((buffer[from] == '*') && (buffer[from + 1] == ')'))
+      return from + 2;
+    from ++;
+  }
+  return -1;
+}
+
+#if CHARSCAN_SIMD
+
+/******************* SSE2 versions ******************************/
+
+// A byte is in [lo, lo + n] iff min(c - lo, n) == c - lo, unsigned
+#define SSE2_IN_RANGE(c, lo, n) \
+  _mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8((c), _mm_set1_epi8(lo)), _mm_set1_epi8(n)), \
+		 _mm_sub_epi8((c), _mm_set1_epi8(lo)))
+
+__attribute__((target("sse2")))
+int spanBlankSSE2(char* buffer, int from, int length) {
+  while (from + 16 <= length) {
+    __m128i c = _mm_loadu_si128((__m128i*) (buffer + from));
+    __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), SSE2_IN_RANGE(c, 9, 4));
+    unsigned int mask = ~_mm_movemask_epi8(blank) & 0xFFFF;
+    if (mask != 0) return from + __builtin_ctz(mask);
+    from += 16;
+  }
+  return spanBlankScalar(buffer, from, length);
+}
+
+__attribute__((target("sse2")))
+int spanIdentSSE2(char* buffer, int from, int length) {
+  while (from + 16 <= length) {
+    __m128i c = _mm_loadu_si128((__m128i*) (buffer + from));
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i ident = _mm_or_si128(SSE2_IN_RANGE(lower, 'a', 25), SSE2_IN_RANGE(c, '0', 9));
+    unsigned int mask = ~_mm_movemask_epi8(ident) & 0xFFFF;
+    if (mask != 0) return from + __builtin_ctz(mask);
+    from += 16;
+  }
+  return spanIdentScalar(buffer, from, length);
+}
+
+__attribute__((target("sse2")))
+int spanDigitsSSE2(char* buffer, int from, int length) {
+  while (from + 16 <= length) {
+    __m128i c = _mm_loadu_si128((__m128i*) (buffer + from));
+    unsigned int mask = ~_mm_movemask_epi8(SSE2_IN_RANGE(c, '0', 9)) & 0xFFFF;
+    if (mask != 0) return from + __builtin_ctz(mask);
+    from += 16;
+  }
+  return spanDigitsScalar(buffer, from, length);
+}
+
+__attribute__((target("sse2")))
+int findCommentEndSSE2(char* buffer, int from, int length) {
+  while (from + 17 <= length) {
+    __m128i star = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (buffer + from)), _mm_set1_epi8('*'));
+    __m128i rpar = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (buffer + from + 1)), _mm_set1_epi8(')'));
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(star, rpar));
+    if (mask != 0) return from + __builtin_ctz(mask) + 2;
+    from += 16;
+  }
+  return findCommentEndScalar(buffer, from, length);
+}
+
+/******************* AVX2 versions ******************************/
+
+#define AVX2_IN_RANGE(c, lo, n) \
+  _mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_sub_epi8((c), _mm256_set1_epi8(lo)), _mm256_set1_epi8(n)), \
+		    _mm256_sub_epi8((c), _mm256_set1_epi8(lo)))
+
+__attribute__((target("avx2")))
+int spanBlankAVX2(char* buffer, int from, int length) {
+  while (from + 32 <= length) {
+    __m256i c = _mm256_loadu_si256((__m256i*) (buffer + from));
+    __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), AVX2_IN_RANGE(c, 9, 4));
+    unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(blank);
+    if (mask != 0) return from + __builtin_ctz(mask);
+    from += 32;
+  }
+  return spanBlankSSE2(buffer, from, length);
+}
+
+__attribute__((target("avx2")))
+int spanIdentAVX2(char* buffer, int from, int length) {
+  while (from + 32 <= length) {
+    __m256i c = _mm256_loadu_si256((__m256i*) (buffer + from));
+    __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i ident = _mm256_or_si256(AVX2_IN_RANGE(lower, 'a', 25), AVX2_IN_RANGE(c, '0', 9));
+    unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(ident);
+    if (mask != 0) return from + __builtin_ctz(mask);
+    from += 32;
+  }
+  return spanIdentSSE2(buffer, from, length);
+}
+
+__attribute__((target("avx2")))
+int spanDigitsAVX2(char* buffer, int from, int length) {
+  while (from + 32 <= length) {
+    __m256i c = _mm256_loadu_si256((__m256i*) (buffer + from));
+    unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(AVX2_IN_RANGE(c, '0', 9));
+    if (mask != 0) return from + __builtin_ctz(mask);
+    from += 32;
+  }
+  return spanDigitsSSE2(buffer, from, length);
+}
+
+__attribute__((target("avx2")))
+int findCommentEndAVX2(char* buffer, int from, int length) {
+  while (from + 33 <= length) {
+    __m256i star = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*) (buffer + from)), _mm256_set1_epi8('*'));
+    __m256i rpar = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*) (buffer + from + 1)), _mm256_set1_epi8(')'));
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_and_si256(star, rpar));
+    if (mask != 0) return from + __builtin_ctz(mask) + 2;
+    from += 32;
+  }
+  return findCommentEndSSE2(buffer, from, length);
+}
+
+#endif
+
+/******************* Dispatch ******************************/
+
+int (*spanBlank)(char* buffer, int from, int length) = spanBlankScalar;
+int (*spanIdent)(char* buffer, int from, int length) = spanIdentScalar;
+int (*spanDigits)(char* buffer, int from, int length) = spanDigitsScalar;
+int (*findCommentEnd)(char* buffer, int from, int length) = findCommentEndScalar;
+
+void initCharScan(void) {
+#if CHARSCAN_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    spanBlank = spanBlankAVX2;
+    spanIdent = spanIdentAVX2;
+    spanDigits = spanDigitsAVX2;
+    findCommentEnd = findCommentEndAVX2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    spanBlank = spanBlankSSE2;
+    spanIdent = spanIdentSSE2;
+    spanDigits = spanDigitsSSE2;
+    findCommentEnd = findCommentEndSSE2;
+  }
+#endif
+}
@@ -0,0 +1,17 @@
+/* Bulk character classification */
+
+#ifndef __CHARSCAN_H__
+#define __CHARSCAN_H__
+
+// Each function looks at buffer[from .. length-1] and returns an offset in
+// [from, length]. They agree with charCodes[] but classify 16 or 32 bytes
+// per step when the CPU allows it. initCharScan picks the implementation.
+
+extern int (*spanBlank)(char* buffer, int from, int length);      // first non CHAR_SPACE
+extern int (*spanIdent)(char* buffer, int from, int length);      // first non letter/digit
+extern int (*spanDigits)(char* buffer, int from, int length);     // first non digit
+extern int (*findCommentEnd)(char* buffer, int from, int length); // just past "*)", or -1
+
+void initCharScan(void);
+
+#endif
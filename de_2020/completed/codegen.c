@@ -5,19 +5,22 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include "state.h"
 #include "reader.h"
 #include "codegen.h"  
 
 #define CODE_SIZE 10000
-extern SymTab* symtab;
+extern COMPILER_STATE SymTab* symtab;
 
-extern Object* readiFunction;
-extern Object* readcFunction;
-extern Object* writeiProcedure;
-extern Object* writecProcedure;
-extern Object* writelnProcedure;
+extern COMPILER_STATE Object* readiFunction;
+extern COMPILER_STATE Object* readcFunction;
+extern COMPILER_STATE Object* writeiProcedure;
+extern COMPILER_STATE Object* writecProcedure;
+extern COMPILER_STATE Object* writelnProcedure;
 
-CodeBlock* codeBlock;
+COMPILER_STATE CodeBlock* codeBuffer;
+COMPILER_STATE int forDepth;           // FOR loops around the code being generated
 
 int computeNestedLevel(Scope* scope) {
   int level = 0;
@@ -75,8 +78,8 @@ void genPredefinedProcedureCall(Object* proc) {
 }
 
 void genProcedureCall(Object* proc) {
-  int level = computeNestedLevel(proc->procAttrs->scope->outer);
-  genCALL(level, proc->procAttrs->codeAddress);
+  int level = computeNestedLevel(proc->procAttrs.scope->outer);
+  genCALL(level, proc->procAttrs.codeAddress);
 }
 
 void genPredefinedFunctionCall(Object* func) {
@@ -87,136 +90,152 @@ void genPredefinedFunctionCall(Object* func) {
 }
 
 void genFunctionCall(Object* func) {
-  int level = computeNestedLevel(func->funcAttrs->scope->outer);
-  genCALL(level, func->funcAttrs->codeAddress);
+  int level = computeNestedLevel(func->funcAttrs.scope->outer);
+  genCALL(level, func->funcAttrs.codeAddress);
 }
 
 void genLA(int level, int offset) {
-  emitLA(codeBlock, level, offset);
+  emitLA(codeBuffer, level, offset);
 }
 
 void genLV(int level, int offset) {
-  emitLV(codeBlock, level, offset);
+  emitLV(codeBuffer, level, offset);
 }
 
 void genLC(WORD constant) {
-  emitLC(codeBlock, constant);
+  emitLC(codeBuffer, constant);
 }
 
 void genLI(void) {
-  emitLI(codeBlock);
+  emitLI(codeBuffer);
 }
 
 void genINT(int delta) {
-  emitINT(codeBlock,delta);
+  emitINT(codeBuffer,delta);
 }
 
 void genDCT(int delta) {
-  emitDCT(codeBlock,delta);
+  emitDCT(codeBuffer,delta);
 }
 
 Instruction* genJ(CodeAddress label) {
-  Instruction* inst = codeBlock->code + codeBlock->codeSize;
-  emitJ(codeBlock,label);
+  Instruction* inst = codeBuffer->code + codeBuffer->codeSize;
+  emitJ(codeBuffer,label);
   return inst;
 }
 
 Instruction* genFJ(CodeAddress label) {
-  Instruction* inst = codeBlock->code + codeBlock->codeSize;
-  emitFJ(codeBlock, label);
+  Instruction* inst = codeBuffer->code + codeBuffer->codeSize;
+  emitFJ(codeBuffer, label);
   return inst;
 }
 
 void genHL(void) {
-  emitHL(codeBlock);
+  emitHL(codeBuffer);
 }
 
 void genST(void) {
-  emitST(codeBlock);
+  emitST(codeBuffer);
 }
 
 void genCALL(int level, CodeAddress label) {
-  emitCALL(codeBlock, level, label);
+  emitCALL(codeBuffer, level, label);
 }
 
 void genEP(void) {
-  emitEP(codeBlock);
+  emitEP(codeBuffer);
 }
 
 void genEF(void) {
-  emitEF(codeBlock);
+  emitEF(codeBuffer);
 }
 
 void genRC(void) {
-  emitRC(codeBlock);
+  emitRC(codeBuffer);
 }
 
 void genRI(void) {
-  emitRI(codeBlock);
+  emitRI(codeBuffer);
 }
 
 void genWRC(void) {
-  emitWRC(codeBlock);
+  emitWRC(codeBuffer);
 }
 
 void genWRI(void) {
-  emitWRI(codeBlock);
+  emitWRI(codeBuffer);
 }
 
 void genWLN(void) {
-  emitWLN(codeBlock);
+  emitWLN(codeBuffer);
 }
 
 void genAD(void) {
-  emitAD(codeBlock);
+  emitAD(codeBuffer);
 }
 
 void genSB(void) {
-  emitSB(codeBlock);
+  emitSB(codeBuffer);
 }
 
 void genML(void) {
-  emitML(codeBlock);
+  emitML(codeBuffer);
 }
 
 void genDV(void) {
-  emitDV(codeBlock);
+  emitDV(codeBuffer);
 }
 
 void genPW(void) {
-  emitPW(codeBlock); // đề 2020 bài 1
+  emitPW(codeBuffer); // đề 2020 bài 1
 }
 
 void genNEG(void) {
-  emitNEG(codeBlock);
+  emitNEG(codeBuffer);
 }
 
 void genCV(void) {
-  emitCV(codeBlock);
+  emitCV(codeBuffer);
 }
 
 void genEQ(void) {
-  emitEQ(codeBlock);
+  emitEQ(codeBuffer);
 }
 
 void genNE(void) {
-  emitNE(codeBlock);
+  emitNE(codeBuffer);
 }
 
 void genGT(void) {
-  emitGT(codeBlock);
+  emitGT(codeBuffer);
 }
 
 void genGE(void) {
-  emitGE(codeBlock);
+  emitGE(codeBuffer);
 }
 
 void genLT(void) {
-  emitLT(codeBlock);
+  emitLT(codeBuffer);
 }
 
 void genLE(void) {
-  emitLE(codeBlock);
+  emitLE(codeBuffer);
+}
+
+Instruction* genTJ(CodeAddress label) {
+  Instruction* inst = codeBuffer->code + codeBuffer->codeSize;
+  emitTJ(codeBuffer, label);
+  return inst;
+}
+
+Instruction* genFORPREP(int offset, CodeAddress label) {
+  Instruction* inst = codeBuffer->code + codeBuffer->codeSize;
+  emitFORPREP(codeBuffer, offset, label);
+  return inst;
+}
+
+void genFORLOOP(int offset, CodeAddress label) {
+  emitFORLOOP(codeBuffer, offset, label);
 }
 
 void updateJ(Instruction* jmp, CodeAddress label) {
@@ -227,8 +246,12 @@ void updateFJ(Instruction* jmp, CodeAddress label) {
   jmp->q = label;
 }
 
+void updateFORPREP(Instruction* jmp, CodeAddress label) {
+  jmp->q = label;
+}
+
 CodeAddress getCurrentCodeAddress(void) {
-  return codeBlock->codeSize;
+  return codeBuffer->codeSize;
 }
 
 int isPredefinedFunction(Object* func) {
@@ -239,24 +262,532 @@ int isPredefinedProcedure(Object* proc) {
   return ((proc == writeiProcedure) || (proc == writecProcedure) || (proc == writelnProcedure));
 }
 
+/******************* Lowering ******************************/
+
+// The tree is lowered in source order with the symbol table's current
+// scope following along, so nesting levels are counted as the parser saw
+// them. A subprogram's code address is fixed when its block is reached,
+// which is always before any call to it is lowered.
+
+// The words from an array's first element to the one its constant
+// subscripts select; they go into the LA or LV offset
+int constantIndexOffset(Type* arrayType, Expression* indexes) {
+  unsigned int offset = 0;
+  Expression* index;
+
+  for (index = indexes; index != NULL; index = index->next) {
+    if (index->kind == EXP_CONSTANT)
+      offset += (unsigned int) index->value * (unsigned int) sizeOfType(arrayType->elementType);
+    arrayType = arrayType->elementType;
+  }
+  return (int) offset;
+}
+
+int hasVariableIndex(Expression* indexes) {
+  for (; indexes != NULL; indexes = indexes->next)
+    if (indexes->kind != EXP_CONSTANT)
+      return 1;
+  return 0;
+}
+
+// Adds the other subscripts to the address on the stack
+void genIndexes(Type* arrayType, Expression* indexes) {
+  Expression* index;
+  int size;
+
+  for (index = indexes; index != NULL; index = index->next) {
+    if (index->kind != EXP_CONSTANT) {
+      genExpression(index);
+      size = sizeOfType(arrayType->elementType);
+      if (size != 1) {
+	genLC(size);
+	genML();
+      }
+      genAD();
+    }
+    arrayType = arrayType->elementType;
+  }
+}
+
+void genArrayElementAddress(LValue* lvalue) {
+  Object* obj = lvalue->object;
+  int level = computeNestedLevel(VARIABLE_SCOPE(obj));
+
+  genLA(level, VARIABLE_OFFSET(obj) + constantIndexOffset(obj->varAttrs.type, lvalue->indexes));
+  genIndexes(obj->varAttrs.type, lvalue->indexes);
+}
+
+void genArrayElementValue(LValue* lvalue) {
+  Object* obj = lvalue->object;
+  int level = computeNestedLevel(VARIABLE_SCOPE(obj));
+
+  if (hasVariableIndex(lvalue->indexes)) {
+    genArrayElementAddress(lvalue);
+    genLI();
+  } else genLV(level, VARIABLE_OFFSET(obj) + constantIndexOffset(obj->varAttrs.type, lvalue->indexes));
+}
+
+void genLValueAddress(LValue* lvalue) {
+  Object* obj = lvalue->object;
+
+  if (obj == NULL) {
+    genExpression(lvalue->address);
+    return;
+  }
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+    if (obj->varAttrs.type->typeClass == TP_ARRAY)
+      genArrayElementAddress(lvalue);
+    else genVariableAddress(obj);
+    break;
+  case OBJ_PARAMETER:
+    if (obj->paramAttrs.kind == PARAM_VALUE)
+      genParameterAddress(obj);
+    else genParameterValue(obj);
+    break;
+  case OBJ_FUNCTION:
+    genReturnValueAddress(obj);
+    break;
+  default:
+    break;
+  }
+}
+
+void genLValueValue(LValue* lvalue) {
+  Object* obj = lvalue->object;
+
+  if (obj == NULL) {
+    genExpression(lvalue->address);
+    genLI();
+    return;
+  }
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+    if (obj->varAttrs.type->typeClass == TP_ARRAY)
+      genArrayElementValue(lvalue);
+    else genVariableValue(obj);
+    break;
+  case OBJ_PARAMETER:
+    genParameterValue(obj);
+    if (obj->paramAttrs.kind == PARAM_REFERENCE)
+      genLI();
+    break;
+  default:
+    break;
+  }
+}
+
+void genArguments(Expression* arguments) {
+  Expression* arg;
+
+  for (arg = arguments; arg != NULL; arg = arg->next)
+    genExpression(arg);
+}
+
+void genOperator(TokenType op) {
+  switch (op) {
+  case SB_PLUS: genAD(); break;
+  case SB_MINUS: genSB(); break;
+  case SB_TIMES: genML(); break;
+  case SB_SLASH: genDV(); break;
+  case SB_POWER: genPW(); break;
+  case SB_EQ: genEQ(); break;
+  case SB_NEQ: genNE(); break;
+  case SB_LE: genLE(); break;
+  case SB_LT: genLT(); break;
+  case SB_GE: genGE(); break;
+  case SB_GT: genGT(); break;
+  default: break;
+  }
+}
+
+void genExpression(Expression* exp) {
+  Object* func;
+  Chain chain;
+  int i;
+
+  switch (exp->kind) {
+  case EXP_CONSTANT:
+    genLC(exp->value);
+    break;
+  case EXP_VARIABLE:
+    genLValueValue(exp->lvalue);
+    break;
+  case EXP_REFERENCE:
+    genLValueAddress(exp->lvalue);
+    break;
+  case EXP_CALL:
+    func = exp->call.function;
+    if (isPredefinedFunction(func)) {
+      genArguments(exp->call.arguments);
+      genPredefinedFunctionCall(func);
+    } else {
+      genINT(RESERVED_WORDS);
+      genArguments(exp->call.arguments);
+      genDCT(RESERVED_WORDS + func->funcAttrs.paramCount);
+      genFunctionCall(func);
+    }
+    break;
+  case EXP_NEGATE:
+    genExpression(exp->operand);
+    genNEG();
+    break;
+  case EXP_BINARY:
+    openChain(&chain, exp);
+    genExpression(chain.nodes[chain.count - 1]->binary.left);
+    for (i = chain.count - 1; i >= 0; i --) {
+      genExpression(chain.nodes[i]->binary.right);
+      genOperator(chain.nodes[i]->binary.op);
+    }
+    closeChain(&chain);
+    break;
+  case EXP_SAVE:
+    genVariableAddress(exp->save.temp);
+    genExpression(exp->save.operand);
+    genST();
+    genVariableValue(exp->save.temp);
+    break;
+  case EXP_INLINE:
+    genStatement(exp->inlined.body);
+    genExpression(exp->inlined.value);
+    break;
+  }
+}
+
+void genStatement(Statement* st) {
+  Object* proc;
+  Instruction* fjInstruction;
+  Instruction* jInstruction;
+  Instruction* forInstruction;
+  CodeAddress beginLoop;
+  int bound;
+
+  if (st == NULL)
+    return;
+
+  switch (st->kind) {
+  case ST_ASSIGN:
+    genLValueAddress(st->assign.lvalue);
+    genExpression(st->assign.value);
+    genST();
+    break;
+  case ST_CALL:
+    proc = st->call.procedure;
+    if (isPredefinedProcedure(proc)) {
+      genArguments(st->call.arguments);
+      genPredefinedProcedureCall(proc);
+    } else {
+      genINT(RESERVED_WORDS);
+      genArguments(st->call.arguments);
+      genDCT(RESERVED_WORDS + proc->procAttrs.paramCount);
+      genProcedureCall(proc);
+    }
+    break;
+  case ST_GROUP:
+    genStatements(st->body);
+    break;
+  case ST_IF:
+    genExpression(st->ifSt.condition);
+    fjInstruction = genFJ(DC_VALUE);
+    genStatement(st->ifSt.thenPart);
+    if (st->ifSt.elsePart != NULL) {
+      jInstruction = genJ(DC_VALUE);
+      updateFJ(fjInstruction, getCurrentCodeAddress());
+      genStatement(st->ifSt.elsePart);
+      updateJ(jInstruction, getCurrentCodeAddress());
+    } else updateFJ(fjInstruction, getCurrentCodeAddress());
+    break;
+  case ST_WHILE:
+    // The condition is tested once on the way in, then again at the
+    // bottom of the body, which jumps back while it holds
+    genExpression(st->whileSt.condition);
+    fjInstruction = genFJ(DC_VALUE);
+    beginLoop = getCurrentCodeAddress();
+    genStatement(st->whileSt.body);
+    genExpression(st->whileSt.condition);
+    genTJ(beginLoop);
+    updateFJ(fjInstruction, getCurrentCodeAddress());
+    break;
+  case ST_FOR:
+    // The variable's address stays on the stack for the whole loop, and
+    // the bound, evaluated once, in a hidden slot past the block's
+    // variables. FORLOOP pops the address when the loop is over.
+    bound = symtab->currentScope->frameSize + forDepth;
+    genLValueAddress(st->forSt.variable);
+    genCV();
+    genExpression(st->forSt.from);
+    genLA(0, bound);
+    genExpression(st->forSt.to);
+    genST();
+    genST();
+    forInstruction = genFORPREP(bound, DC_VALUE);
+    beginLoop = getCurrentCodeAddress();
+
+    forDepth ++;
+    genStatement(st->forSt.body);
+    forDepth --;
+
+    genFORLOOP(bound, beginLoop);
+    updateFORPREP(forInstruction, getCurrentCodeAddress());
+    break;
+  }
+}
+
+// How deeply FOR loops nest in st and the statements after it
+int forNesting(Statement* st) {
+  int nesting = 0;
+  int n, m;
+
+  for (; st != NULL; st = st->next) {
+    switch (st->kind) {
+    case ST_GROUP:
+      n = forNesting(st->body);
+      break;
+    case ST_IF:
+      n = forNesting(st->ifSt.thenPart);
+      m = forNesting(st->ifSt.elsePart);
+      if (m > n)
+	n = m;
+      break;
+    case ST_WHILE:
+      n = forNesting(st->whileSt.body);
+      break;
+    case ST_FOR:
+      n = 1 + forNesting(st->forSt.body);
+      break;
+    default:
+      n = 0;
+      break;
+    }
+    if (n > nesting)
+      nesting = n;
+  }
+  return nesting;
+}
+
+void genStatements(Statement* st) {
+  for (; st != NULL; st = st->next)
+    genStatement(st);
+}
+
+// Jumps over the code of the nested subprograms to the block's own body
+void genBlock(Block* block) {
+  Object* owner = block->owner;
+  Instruction* jmp;
+  Block* subBlock;
+
+  switch (owner->kind) {
+  case OBJ_PROGRAM:
+    owner->progAttrs.codeAddress = getCurrentCodeAddress();
+    break;
+  case OBJ_FUNCTION:
+    owner->funcAttrs.codeAddress = getCurrentCodeAddress();
+    break;
+  case OBJ_PROCEDURE:
+    owner->procAttrs.codeAddress = getCurrentCodeAddress();
+    break;
+  default:
+    break;
+  }
+
+  enterBlock(block->scope);
+  jmp = genJ(DC_VALUE);
+  for (subBlock = block->subBlocks; subBlock != NULL; subBlock = subBlock->next)
+    genBlock(subBlock);
+
+  updateJ(jmp, getCurrentCodeAddress());
+  // Room for the bounds of the FOR loops too
+  genINT(block->scope->frameSize + forNesting(block->body));
+  genStatements(block->body);
+
+  switch (owner->kind) {
+  case OBJ_PROGRAM:
+    genHL();
+    break;
+  case OBJ_FUNCTION:
+    genEF();
+    break;
+  default:
+    genEP();
+    break;
+  }
+  exitBlock();
+}
+
+void genProgram(Block* program) {
+  genBlock(program);
+}
+
+/******************* Peephole ******************************/
+
+// Rewrites the generated code a few instructions at a time and squeezes
+// out what it removes. A pair is only rewritten if nothing jumps to its
+// second instruction. Rounds are repeated until one changes nothing,
+// since each may expose work for the next.
+
+#define REMOVED (-1)
+
+int isBranch(Instruction* inst) {
+  return (inst->op == OP_J) || (inst->op == OP_FJ) || (inst->op == OP_TJ) ||
+    (inst->op == OP_FORPREP) || (inst->op == OP_FORLOOP);
+}
+
+int isJumpOrCall(Instruction* inst) {
+  return isBranch(inst) || (inst->op == OP_CALL);
+}
+
+// Where a jump to target really lands, going through unconditional
+// jumps. A loop of jumps is left as it is.
+CodeAddress threadJump(CodeBlock* codeBlock, CodeAddress target) {
+  CodeAddress to = target;
+  int steps = 0;
+
+  while (codeBlock->code[to].op == OP_J) {
+    to = codeBlock->code[to].q;
+    if (++ steps > codeBlock->codeSize)
+      return target;
+  }
+  return to;
+}
+
+// Marks the instructions control can reach from the program's entry
+void markReachable(CodeBlock* codeBlock, char* reachable) {
+  CodeAddress* work = (CodeAddress*) malloc((codeBlock->codeSize + 1) * sizeof(CodeAddress));
+  int count = 0;
+  CodeAddress pc;
+  Instruction* inst;
+
+  work[count ++] = 0;
+  while (count > 0) {
+    pc = work[-- count];
+    while ((pc < codeBlock->codeSize) && !reachable[pc]) {
+      reachable[pc] = 1;
+      inst = codeBlock->code + pc;
+      if (isJumpOrCall(inst) && !reachable[inst->q])
+	work[count ++] = inst->q;
+      if ((inst->op == OP_J) || (inst->op == OP_HL) || (inst->op == OP_EP) || (inst->op == OP_EF))
+	break;
+      pc ++;
+    }
+  }
+  free(work);
+}
+
+int peepholeRound(CodeBlock* codeBlock) {
+  Instruction* code = codeBlock->code;
+  int size = codeBlock->codeSize;
+  char* target = (char*) calloc(size + 1, 1);
+  char* reachable = (char*) calloc(size + 1, 1);
+  CodeAddress* relocation = (CodeAddress*) malloc((size + 1) * sizeof(CodeAddress));
+  int changed = 0;
+  CodeAddress pc, to;
+
+  // Jumps to jumps go straight to the end of the chain
+  for (pc = 0; pc < size; pc ++)
+    if (isBranch(code + pc)) {
+      to = threadJump(codeBlock, code[pc].q);
+      if (to != code[pc].q) {
+	code[pc].q = to;
+	changed = 1;
+      }
+    }
+
+  for (pc = 0; pc < size; pc ++)
+    if (isJumpOrCall(code + pc))
+      target[code[pc].q] = 1;
+
+  for (pc = 0; pc < size; pc ++) {
+    if ((code[pc].op == OP_J) && (code[pc].q == pc + 1)) {
+      // Also the jump over nested declarations when there are none
+      code[pc].op = (enum OpCode) REMOVED;
+      changed = 1;
+      continue;
+    }
+    if ((pc + 1 >= size) || target[pc + 1])
+      continue;
+
+    if ((code[pc].op == OP_LA) && (code[pc + 1].op == OP_LI)) {
+      code[pc].op = OP_LV;
+      code[pc + 1].op = (enum OpCode) REMOVED;
+    } else if ((code[pc].op == OP_LC) && (code[pc].q == 0) &&
+	       ((code[pc + 1].op == OP_AD) || (code[pc + 1].op == OP_SB))) {
+      code[pc].op = (enum OpCode) REMOVED;
+      code[pc + 1].op = (enum OpCode) REMOVED;
+    } else if ((code[pc].op == OP_LC) && (code[pc].q == 1) &&
+	       ((code[pc + 1].op == OP_ML) || (code[pc + 1].op == OP_DV))) {
+      code[pc].op = (enum OpCode) REMOVED;
+      code[pc + 1].op = (enum OpCode) REMOVED;
+    } else if ((code[pc].op == OP_LC) && (code[pc + 1].op == OP_FJ)) {
+      // A constant condition: always jump, or never
+      if (code[pc].q == 0)
+	code[pc + 1].op = OP_J;
+      else code[pc + 1].op = (enum OpCode) REMOVED;
+      code[pc].op = (enum OpCode) REMOVED;
+    } else if ((code[pc].op == OP_LC) && (code[pc + 1].op == OP_TJ)) {
+      if (code[pc].q != 0)
+	code[pc + 1].op = OP_J;
+      else code[pc + 1].op = (enum OpCode) REMOVED;
+      code[pc].op = (enum OpCode) REMOVED;
+    } else continue;
+    changed = 1;
+    pc ++;
+  }
+
+  // Removed instructions fall through, so they are not followed here
+  markReachable(codeBlock, reachable);
+  for (pc = 0; pc < size; pc ++)
+    if (!reachable[pc] && (code[pc].op != (enum OpCode) REMOVED)) {
+      code[pc].op = (enum OpCode) REMOVED;
+      changed = 1;
+    }
+
+  // A jump to a removed instruction lands on the next one kept
+  to = 0;
+  for (pc = 0; pc < size; pc ++) {
+    relocation[pc] = to;
+    if (code[pc].op != (enum OpCode) REMOVED)
+      code[to ++] = code[pc];
+  }
+  relocation[size] = to;
+  codeBlock->codeSize = to;
+  for (pc = 0; pc < to; pc ++)
+    if (isJumpOrCall(code + pc))
+      code[pc].q = relocation[code[pc].q];
+
+  free(target);
+  free(reachable);
+  free(relocation);
+  return changed;
+}
+
+void optimizeCodeBlock(CodeBlock* codeBlock) {
+  while (peepholeRound(codeBlock))
+    ;
+}
+
 void initCodeBuffer(void) {
-  codeBlock = createCodeBlock(CODE_SIZE);
+  codeBuffer = createCodeBlock(CODE_SIZE);
 }
 
-void printCodeBuffer(void) {
-  printCodeBlock(codeBlock);
+// Hands the generated code over to the caller
+CodeBlock* takeCodeBuffer(void) {
+  CodeBlock* block = codeBuffer;
+  codeBuffer = NULL;
+  return block;
 }
 
 void cleanCodeBuffer(void) {
-  freeCodeBlock(codeBlock);
+  if (codeBuffer != NULL)
+    freeCodeBlock(codeBuffer);
+  codeBuffer = NULL;
 }
 
-int serialize(char* fileName) {
+int serialize(CodeBlock* block, char* fileName) {
   FILE* f;
 
   f = fopen(fileName, "wb");
   if (f == NULL) return IO_ERROR;
-  saveCode(codeBlock, f);
+  saveCode(block, f);
   fclose(f);
   return IO_SUCCESS;
 }
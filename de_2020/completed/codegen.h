@@ -8,26 +8,27 @@
 #define __CODEGEN_H__
 
 #include "symtab.h"
+#include "ast.h"
 #include "instructions.h"
 
 #define RESERVED_WORDS 4
 
-#define PROCEDURE_PARAM_COUNT(proc) (proc->procAttrs->numOfParams)
-#define PROCEDURE_SCOPE(proc) (proc->procAttrs->scope)
-#define PROCEDURE_FRAME_SIZE(proc) (proc->procAttrs->scope->frameSize)
+#define PROCEDURE_PARAM_COUNT(proc) (proc->procAttrs.numOfParams)
+#define PROCEDURE_SCOPE(proc) (proc->procAttrs.scope)
+#define PROCEDURE_FRAME_SIZE(proc) (proc->procAttrs.scope->frameSize)
 
-#define FUNCTION_PARAM_COUNT(func) (func->funcAttrs->numOfParams)
-#define FUNCTION_SCOPE(func) (func->funcAttrs->scope)
-#define FUNCTION_FRAME_SIZE(func) (func->funcAttrs->scope->frameSize)
+#define FUNCTION_PARAM_COUNT(func) (func->funcAttrs.numOfParams)
+#define FUNCTION_SCOPE(func) (func->funcAttrs.scope)
+#define FUNCTION_FRAME_SIZE(func) (func->funcAttrs.scope->frameSize)
 
-#define PROGRAM_SCOPE(prog) (prog->progAttrs->scope)
-#define PROGRAM_FRAME_SIZE(prog) (prog->progAttrs->scope->frameSize)
+#define PROGRAM_SCOPE(prog) (prog->progAttrs.scope)
+#define PROGRAM_FRAME_SIZE(prog) (prog->progAttrs.scope->frameSize)
 
-#define VARIABLE_OFFSET(var) (var->varAttrs->localOffset)
-#define VARIABLE_SCOPE(var) (var->varAttrs->scope)
+#define VARIABLE_OFFSET(var) (var->varAttrs.localOffset)
+#define VARIABLE_SCOPE(var) (var->varAttrs.scope)
 
-#define PARAMETER_OFFSET(param) (param->paramAttrs->localOffset)
-#define PARAMETER_SCOPE(param) (param->paramAttrs->scope)
+#define PARAMETER_OFFSET(param) (param->paramAttrs.localOffset)
+#define PARAMETER_SCOPE(param) (param->paramAttrs.scope)
 
 #define RETURN_VALUE_OFFSET 0
 #define DYNAMIC_LINK_OFFSET 1
@@ -45,8 +46,8 @@ void genParameterValue(Object* param);
 void genReturnValueAddress(Object* func);
 void genReturnValueAddress(Object* func);
 
-void genArrayElementAddress(Type* arrayType);
-void genArrayElementValue(Type* arrayType);
+void genArrayElementAddress(LValue* lvalue);
+void genArrayElementValue(LValue* lvalue);
 
 void genPredefinedProcedureCall(Object* proc);
 void genProcedureCall(Object* proc);
@@ -62,6 +63,7 @@ void genINT(int delta);
 void genDCT(int delta);
 Instruction* genJ(CodeAddress label);
 Instruction* genFJ(CodeAddress label);
+Instruction* genTJ(CodeAddress label);
 void genHL(void);
 void genST(void);
 void genCALL(int level, CodeAddress label);
@@ -85,18 +87,37 @@ void genGT(void);
 void genGE(void);
 void genLT(void);
 void genLE(void);
+Instruction* genFORPREP(int offset, CodeAddress label);
+void genFORLOOP(int offset, CodeAddress label);
 
 void updateJ(Instruction* jmp, CodeAddress label);
 void updateFJ(Instruction* jmp, CodeAddress label);
+void updateFORPREP(Instruction* jmp, CodeAddress label);
 
 CodeAddress getCurrentCodeAddress(void);
 int isPredefinedProcedure(Object* proc);
 int isPredefinedFunction(Object* func);
 
+int constantIndexOffset(Type* arrayType, Expression* indexes);
+int hasVariableIndex(Expression* indexes);
+void genIndexes(Type* arrayType, Expression* indexes);
+void genLValueAddress(LValue* lvalue);
+void genLValueValue(LValue* lvalue);
+void genArguments(Expression* arguments);
+void genOperator(TokenType op);
+void genExpression(Expression* exp);
+int forNesting(Statement* st);
+void genStatement(Statement* st);
+void genStatements(Statement* st);
+void genBlock(Block* block);
+void genProgram(Block* program);
+
+void optimizeCodeBlock(CodeBlock* codeBlock);
+
 void initCodeBuffer(void);
-void printCodeBuffer(void);
+CodeBlock* takeCodeBuffer(void);
 void cleanCodeBuffer(void);
 
-int serialize(char* fileName);
+int serialize(CodeBlock* block, char* fileName);
 
 #endif
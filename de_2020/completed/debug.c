@@ -46,44 +46,44 @@ void printObject(Object* obj, int indent) {
   case OBJ_CONSTANT:
     pad(indent);
     printf("Const %s = ", obj->name);
-    printConstantValue(obj->constAttrs->value);
+    printConstantValue(obj->constAttrs.value);
     break;
   case OBJ_TYPE:
     pad(indent);
     printf("Type %s = ", obj->name);
-    printType(obj->typeAttrs->actualType);
+    printType(obj->typeAttrs.actualType);
     break;
   case OBJ_VARIABLE:
     pad(indent);
     printf("Var %s : ", obj->name);
-    printType(obj->varAttrs->type);
-    printf(" at offset %d", obj->varAttrs->localOffset);
+    printType(obj->varAttrs.type);
+    printf(" at offset %d", obj->varAttrs.localOffset);
     break;
   case OBJ_PARAMETER:
     pad(indent);
-    if (obj->paramAttrs->kind == PARAM_VALUE) 
+    if (obj->paramAttrs.kind == PARAM_VALUE) 
       printf("Param %s : ", obj->name);
     else
       printf("Param VAR %s : ", obj->name);
-    printType(obj->paramAttrs->type);
-    printf(" at offset %d", obj->paramAttrs->localOffset);
+    printType(obj->paramAttrs.type);
+    printf(" at offset %d", obj->paramAttrs.localOffset);
     break;
   case OBJ_FUNCTION:
     pad(indent);
     printf("Function %s : ",obj->name);
-    printType(obj->funcAttrs->returnType);
-    printf(" at address %d\n", obj->funcAttrs->codeAddress);
-    printScope(obj->funcAttrs->scope, indent + 4);
+    printType(obj->funcAttrs.returnType);
+    printf(" at address %d\n", obj->funcAttrs.codeAddress);
+    printScope(obj->funcAttrs.scope, indent + 4);
     break;
   case OBJ_PROCEDURE:
     pad(indent);
-    printf("Procedure %s at address %d\n",obj->name, obj->procAttrs->codeAddress);
-    printScope(obj->procAttrs->scope, indent + 4);
+    printf("Procedure %s at address %d\n",obj->name, obj->procAttrs.codeAddress);
+    printScope(obj->procAttrs.scope, indent + 4);
     break;
   case OBJ_PROGRAM:
     pad(indent);
-    printf("Program %s at address %d\n",obj->name, obj->progAttrs->codeAddress);
-    printScope(obj->progAttrs->scope, indent + 4);
+    printf("Program %s at address %d\n",obj->name, obj->progAttrs.codeAddress);
+    printScope(obj->progAttrs.scope, indent + 4);
     break;
   }
 }
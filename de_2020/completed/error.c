@@ -6,16 +6,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "state.h"
+#include "reader.h"
 #include "error.h"
 
-#define NUM_OF_ERRORS 29
-
 struct ErrorMessage {
   ErrorCode errorCode;
   char *message;
 };
 
-struct ErrorMessage errors[29] = {
+struct ErrorMessage errors[] = {
   {ERR_END_OF_COMMENT, "End of comment expected."},
   {ERR_IDENT_TOO_LONG, "Identifier too long."},
   {ERR_INVALID_CONSTANT_CHAR, "Invalid char constant."},
@@ -23,6 +23,8 @@ struct ErrorMessage errors[29] = {
   {ERR_INVALID_IDENT, "An identifier expected."},
   {ERR_INVALID_CONSTANT, "A constant expected."},
   {ERR_INVALID_TYPE, "A type expected."},
+  {ERR_INVALID_ARRAY_SIZE, "An array size cannot be negative."},
+  {ERR_CONSTANT_OVERFLOW, "A constant expression overflows."},
   {ERR_INVALID_BASICTYPE, "A basic type expected."},
   {ERR_INVALID_VARIABLE, "A variable expected."},
   {ERR_INVALID_FUNCTION, "A function identifier expected."},
@@ -47,18 +49,62 @@ struct ErrorMessage errors[29] = {
   {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."}
 };
 
-void error(ErrorCode err, int lineNo, int colNo) {
+#define NUM_OF_ERRORS ((int) (sizeof(errors) / sizeof(errors[0])))
+
+// Diagnostics go to the list started by startDiagnostics, after which
+// error() unwinds to the caller's errorExit. Without one they are printed
+// and the program ends, as the compiler always used to do.
+COMPILER_STATE jmp_buf* errorExit = NULL;
+COMPILER_STATE Diagnostic* diagnostics;
+COMPILER_STATE int diagnosticCount;
+
+void startDiagnostics(jmp_buf* exitTo) {
+  errorExit = exitTo;
+  diagnostics = NULL;
+  diagnosticCount = 0;
+}
+
+// Hands the diagnostics (malloc'ed, NULL if there are none) to the caller
+Diagnostic* endDiagnostics(int* count) {
+  Diagnostic* list = diagnostics;
+
+  *count = diagnosticCount;
+  errorExit = NULL;
+  diagnostics = NULL;
+  diagnosticCount = 0;
+  return list;
+}
+
+// offset is where the error lies in the source buffer
+void reportError(int offset, char* format, char* text) {
+  Diagnostic* diagnostic;
+  int lineNo, colNo;
+
+  locateOffset(offset, &lineNo, &colNo);
+  if (errorExit == NULL) {
+    printf("%d-%d:", lineNo, colNo);
+    printf(format, text);
+    printf("\n");
+    exit(0);
+  }
+
+  diagnostics = (Diagnostic*) realloc(diagnostics, (diagnosticCount + 1) * sizeof(Diagnostic));
+  diagnostic = diagnostics + diagnosticCount ++;
+  diagnostic->lineNo = lineNo;
+  diagnostic->colNo = colNo;
+  sprintf(diagnostic->message, format, text);
+  longjmp(*errorExit, 1);
+}
+
+void error(ErrorCode err, int offset) {
   int i;
   for (i = 0 ; i < NUM_OF_ERRORS; i ++) 
-    if (errors[i].errorCode == err) {
-      printf("%d-%d:%s\n", lineNo, colNo, errors[i].message);
-      exit(0);
-    }
+    if (errors[i].errorCode == err)
+      reportError(offset, "%s", errors[i].message);
 }
 
-void missingToken(TokenType tokenType, int lineNo, int colNo) {
-  printf("%d-%d:Missing %s\n", lineNo, colNo, tokenToString(tokenType));
-  exit(0);
+void missingToken(TokenType tokenType, int offset) {
+  reportError(offset, "Missing %s", tokenToString(tokenType));
 }
 
 void assert(char *msg) {
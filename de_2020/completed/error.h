@@ -6,6 +6,7 @@
 
 #ifndef __ERROR_H__
 #define __ERROR_H__
+#include <setjmp.h>
 #include "token.h"
 
 typedef enum {
@@ -16,6 +17,8 @@ typedef enum {
   ERR_INVALID_IDENT,
   ERR_INVALID_CONSTANT,
   ERR_INVALID_TYPE,
+  ERR_INVALID_ARRAY_SIZE,
+  ERR_CONSTANT_OVERFLOW,
   ERR_INVALID_BASICTYPE,
   ERR_INVALID_VARIABLE,
   ERR_INVALID_FUNCTION,
@@ -40,8 +43,19 @@ typedef enum {
   ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY
 } ErrorCode;
 
-void error(ErrorCode err, int lineNo, int colNo);
-void missingToken(TokenType tokenType, int lineNo, int colNo);
+#define DIAGNOSTIC_LENGTH 128
+
+struct Diagnostic_ {
+  int lineNo, colNo;
+  char message[DIAGNOSTIC_LENGTH];
+};
+
+typedef struct Diagnostic_ Diagnostic;
+
+void startDiagnostics(jmp_buf* exitTo);
+Diagnostic* endDiagnostics(int* count);
+void error(ErrorCode err, int offset);
+void missingToken(TokenType tokenType, int offset);
 void assert(char *msg);
 
 #endif
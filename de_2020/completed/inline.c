@@ -0,0 +1,718 @@
+/* Inliner */
+
+#include <stdlib.h>
+#include "state.h"
+#include "arena.h"
+#include "optimize.h"
+#include "codegen.h"
+#include "inline.h"
+
+extern COMPILER_STATE Arena* compileArena;
+extern COMPILER_STATE Type* intType;
+
+// A call to a small subprogram is replaced by a copy of its body, run in
+// the caller's frame. Each parameter and local variable of the callee
+// gets a temporary of the caller: a value parameter is assigned its
+// argument, and a reference parameter stands for the variable passed, or
+// for the word at an address kept in a temporary if the variable is an
+// array element. Every other name keeps its meaning, as a subprogram is
+// only called from inside the scope declaring it, where static links
+// reach the same frames.
+//
+// A subprogram is inlined if its body is small once its own calls are
+// inlined, it declares no subprograms, which would need its frame, and
+// it is not called again while its body is rewritten. A function call
+// becomes an expression that runs the body, then reads the result; a
+// function whose body loops is left alone there. Subprograms that are no
+// longer called are dropped.
+
+#define INLINE_MAXIMUM_SIZE 20      // statements and expressions in a body
+
+/******************* Subprograms ******************************/
+
+enum SubprogramState {
+  SUB_NEW,
+  SUB_BUSY,                     // its body is being rewritten
+  SUB_DONE
+};
+
+struct Subprogram_ {
+  Block* block;
+  Block* parent;                // the block declaring it, NULL for the program
+  enum SubprogramState state;
+  int recursive;                // called while its body is rewritten
+  int reached;                  // still called from the program
+};
+
+typedef struct Subprogram_ Subprogram;
+
+struct Inliner_ {
+  Subprogram* subprograms;      // the program first
+  int count;
+  int capacity;
+};
+
+typedef struct Inliner_ Inliner;
+
+void listSubprograms(Inliner* inliner, Block* block, Block* parent) {
+  Subprogram* sub;
+  Block* subBlock;
+
+  if (inliner->count == inliner->capacity) {
+    inliner->capacity = 2 * inliner->capacity + 16;
+    inliner->subprograms = (Subprogram*) realloc(inliner->subprograms, inliner->capacity * sizeof(Subprogram));
+  }
+  sub = inliner->subprograms + inliner->count ++;
+  sub->block = block;
+  sub->parent = parent;
+  sub->state = SUB_NEW;
+  sub->recursive = 0;
+  sub->reached = 0;
+  for (subBlock = block->subBlocks; subBlock != NULL; subBlock = subBlock->next)
+    listSubprograms(inliner, subBlock, block);
+}
+
+Subprogram* findSubprogram(Inliner* inliner, Object* owner) {
+  int i;
+
+  for (i = 0; i < inliner->count; i ++)
+    if (inliner->subprograms[i].block->owner == owner)
+      return inliner->subprograms + i;
+  return NULL;
+}
+
+int expressionSize(Expression* exp);
+int statementSize(Statement* st);
+
+int expressionsSize(Expression* exp) {
+  int size = 0;
+
+  for (; exp != NULL; exp = exp->next)
+    size += expressionSize(exp);
+  return size;
+}
+
+int expressionSize(Expression* exp) {
+  int size;
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    if (exp->lvalue->object == NULL)
+      return 1 + expressionSize(exp->lvalue->address);
+    return 1 + expressionsSize(exp->lvalue->indexes);
+  case EXP_CALL:
+    return 1 + expressionsSize(exp->call.arguments);
+  case EXP_NEGATE:
+    return 1 + expressionSize(exp->operand);
+  case EXP_BINARY:
+    for (size = 0; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      size += 1 + expressionSize(exp->binary.right);
+    return size + expressionSize(exp);
+  case EXP_SAVE:
+    return 1 + expressionSize(exp->save.operand);
+  case EXP_INLINE:
+    return statementSize(exp->inlined.body) + expressionSize(exp->inlined.value);
+  default:
+    return 1;
+  }
+}
+
+int statementsSize(Statement* st) {
+  int size = 0;
+
+  for (; st != NULL; st = st->next)
+    size += statementSize(st);
+  return size;
+}
+
+int statementSize(Statement* st) {
+  LValue* lvalue;
+
+  if (st == NULL) return 0;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    lvalue = st->assign.lvalue;
+    return 1 + ((lvalue->object == NULL) ? expressionSize(lvalue->address) : expressionsSize(lvalue->indexes)) +
+      expressionSize(st->assign.value);
+  case ST_CALL:
+    return 1 + expressionsSize(st->call.arguments);
+  case ST_GROUP:
+    return statementsSize(st->body);
+  case ST_IF:
+    return 1 + expressionSize(st->ifSt.condition) + statementSize(st->ifSt.thenPart) + statementSize(st->ifSt.elsePart);
+  case ST_WHILE:
+    return 1 + expressionSize(st->whileSt.condition) + statementSize(st->whileSt.body);
+  case ST_FOR:
+    return 1 + expressionsSize(st->forSt.variable->indexes) + expressionSize(st->forSt.from) +
+      expressionSize(st->forSt.to) + statementSize(st->forSt.body);
+  default:
+    return 1;
+  }
+}
+
+int hasLoop(Statement* st) {
+  for (; st != NULL; st = st->next)
+    switch (st->kind) {
+    case ST_GROUP:
+      if (hasLoop(st->body)) return 1;
+      break;
+    case ST_IF:
+      if (hasLoop(st->ifSt.thenPart) || hasLoop(st->ifSt.elsePart)) return 1;
+      break;
+    case ST_WHILE:
+    case ST_FOR:
+      return 1;
+    default:
+      break;
+    }
+  return 0;
+}
+
+/******************* Copying a body ******************************/
+
+// What a name of the callee becomes at one call
+struct Replacement_ {
+  Object* from;
+  Object* to;                   // the variable used instead,
+  Object* address;              //   or the temporary keeping its address
+  int owned;                    // made for this call
+};
+
+typedef struct Replacement_ Replacement;
+
+struct Site_ {
+  Object* callee;
+  Scope* calleeScope;
+  Scope* scope;                 // the caller's
+  Replacement* replacements;
+  int count;
+  int capacity;
+};
+
+typedef struct Site_ Site;
+
+Replacement* addReplacement(Site* site, Object* from, Object* to, Object* address, int owned) {
+  Replacement* r;
+
+  if (site->count == site->capacity) {
+    site->capacity = 2 * site->capacity + 8;
+    site->replacements = (Replacement*) realloc(site->replacements, site->capacity * sizeof(Replacement));
+  }
+  r = site->replacements + site->count ++;
+  r->from = from;
+  r->to = to;
+  r->address = address;
+  r->owned = owned;
+  return r;
+}
+
+// The replacement of obj if it belongs to the callee. A local variable
+// gets its temporary the first time it is met.
+Replacement* findReplacement(Site* site, Object* obj) {
+  int i;
+
+  for (i = 0; i < site->count; i ++)
+    if (site->replacements[i].from == obj)
+      return site->replacements + i;
+  if ((obj->kind == OBJ_VARIABLE) && (obj->varAttrs.scope == site->calleeScope))
+    return addReplacement(site, obj, createTemporaryObject(site->scope, obj->varAttrs.type), NULL, 1);
+  return NULL;
+}
+
+Expression* readAddress(Object* temp) {
+  return makeVariableExpression(makeLValue(temp, NULL, intType));
+}
+
+Expression* copyExpression(Site* site, Expression* exp);
+Statement* copyStatement(Site* site, Statement* st);
+
+Expression* copyExpressions(Site* site, Expression* exp) {
+  Expression* first = NULL;
+  Expression* last = NULL;
+  Expression* copy;
+
+  for (; exp != NULL; exp = exp->next) {
+    copy = copyExpression(site, exp);
+    if (first == NULL)
+      first = copy;
+    else last->next = copy;
+    last = copy;
+  }
+  return first;
+}
+
+LValue* copyLValue(Site* site, LValue* lvalue) {
+  Replacement* r;
+
+  if (lvalue->object == NULL)
+    return makeAddressLValue(copyExpression(site, lvalue->address), lvalue->type);
+  r = findReplacement(site, lvalue->object);
+  if (r == NULL)
+    return makeLValue(lvalue->object, copyExpressions(site, lvalue->indexes), lvalue->type);
+  if (r->address != NULL)
+    return makeAddressLValue(readAddress(r->address), lvalue->type);
+  return makeLValue(r->to, copyExpressions(site, lvalue->indexes), lvalue->type);
+}
+
+Expression* copyExpression(Site* site, Expression* exp) {
+  Expression* copy = (Expression*) arenaAlloc(compileArena, sizeof(Expression));
+  Expression* node;
+  Replacement* r;
+
+  *copy = *exp;
+  copy->next = NULL;
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    copy->lvalue = copyLValue(site, exp->lvalue);
+    break;
+  case EXP_CALL:
+    copy->call.arguments = copyExpressions(site, exp->call.arguments);
+    break;
+  case EXP_NEGATE:
+    copy->operand = copyExpression(site, exp->operand);
+    break;
+  case EXP_BINARY:
+    // down a chain, each binary node copied in turn
+    for (node = copy; exp->binary.left->kind == EXP_BINARY; node = node->binary.left) {
+      node->binary.right = copyExpression(site, exp->binary.right);
+      exp = exp->binary.left;
+      node->binary.left = (Expression*) arenaAlloc(compileArena, sizeof(Expression));
+      *node->binary.left = *exp;
+    }
+    node->binary.left = copyExpression(site, exp->binary.left);
+    node->binary.right = copyExpression(site, exp->binary.right);
+    break;
+  case EXP_SAVE:
+    r = findReplacement(site, exp->save.temp);
+    if (r != NULL)
+      copy->save.temp = r->to;
+    copy->save.operand = copyExpression(site, exp->save.operand);
+    break;
+  case EXP_INLINE:
+    copy->inlined.body = copyStatement(site, exp->inlined.body);
+    copy->inlined.value = copyExpression(site, exp->inlined.value);
+    break;
+  default:
+    break;
+  }
+  return copy;
+}
+
+Statement* copyStatements(Site* site, Statement* st) {
+  Statement* first = NULL;
+  Statement* last = NULL;
+  Statement* copy;
+
+  for (; st != NULL; st = st->next) {
+    copy = copyStatement(site, st);
+    if (first == NULL)
+      first = copy;
+    else last->next = copy;
+    last = copy;
+  }
+  return first;
+}
+
+Statement* copyStatement(Site* site, Statement* st) {
+  Statement* copy;
+
+  if (st == NULL) return NULL;
+  copy = (Statement*) arenaAlloc(compileArena, sizeof(Statement));
+  *copy = *st;
+  copy->next = NULL;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    copy->assign.lvalue = copyLValue(site, st->assign.lvalue);
+    copy->assign.value = copyExpression(site, st->assign.value);
+    break;
+  case ST_CALL:
+    copy->call.arguments = copyExpressions(site, st->call.arguments);
+    break;
+  case ST_GROUP:
+    copy->body = copyStatements(site, st->body);
+    break;
+  case ST_IF:
+    copy->ifSt.condition = copyExpression(site, st->ifSt.condition);
+    copy->ifSt.thenPart = copyStatement(site, st->ifSt.thenPart);
+    copy->ifSt.elsePart = copyStatement(site, st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+    copy->whileSt.condition = copyExpression(site, st->whileSt.condition);
+    copy->whileSt.body = copyStatement(site, st->whileSt.body);
+    break;
+  case ST_FOR:
+    copy->forSt.variable = copyLValue(site, st->forSt.variable);
+    copy->forSt.from = copyExpression(site, st->forSt.from);
+    copy->forSt.to = copyExpression(site, st->forSt.to);
+    copy->forSt.body = copyStatement(site, st->forSt.body);
+    break;
+  }
+  return copy;
+}
+
+// Whether what a copied function body sets are only temporaries made for
+// the call, and nothing in it can fail
+int isOwned(Site* site, LValue* lvalue) {
+  int i;
+
+  for (i = 0; i < site->count; i ++)
+    if (site->replacements[i].owned && (site->replacements[i].to == lvalue->object) &&
+	(lvalue->object != NULL))
+      return 1;
+  return 0;
+}
+
+int isPureStatement(Site* site, Statement* st) {
+  Expression* index;
+
+  for (; st != NULL; st = st->next)
+    switch (st->kind) {
+    case ST_ASSIGN:
+      if (!isOwned(site, st->assign.lvalue) || !isPureExpression(st->assign.value))
+	return 0;
+      for (index = st->assign.lvalue->indexes; index != NULL; index = index->next)
+	if (!isPureExpression(index))
+	  return 0;
+      break;
+    case ST_GROUP:
+      if (!isPureStatement(site, st->body)) return 0;
+      break;
+    case ST_IF:
+      if (!isPureExpression(st->ifSt.condition) ||
+	  !isPureStatement(site, st->ifSt.thenPart) || !isPureStatement(site, st->ifSt.elsePart))
+	return 0;
+      break;
+    default:
+      return 0;
+    }
+  return 1;
+}
+
+/******************* Inlining ******************************/
+
+void appendStatement(Statement** first, Statement** last, Statement* st) {
+  if (*first == NULL)
+    *first = st;
+  else (*last)->next = st;
+  *last = st;
+}
+
+// The statements a call to sub runs instead, in the frame of scope: the
+// arguments, in the order they were evaluated, then the body. A function
+// leaves its result in a temporary read by *value; *pure tells whether
+// the statements only set temporaries of their own.
+Statement* expandCall(Scope* scope, Subprogram* sub, Expression* arguments, Expression** value, int* pure) {
+  Object* callee = sub->block->owner;
+  ObjectNode* node;
+  Object* param;
+  Object* temp;
+  Expression* arg;
+  Expression* next;
+  Statement* first = NULL;
+  Statement* last = NULL;
+  Site site;
+
+  site.callee = callee;
+  site.calleeScope = sub->block->scope;
+  site.scope = scope;
+  site.replacements = NULL;
+  site.count = site.capacity = 0;
+
+  node = (callee->kind == OBJ_FUNCTION) ? callee->funcAttrs.paramList : callee->procAttrs.paramList;
+  for (arg = arguments; (arg != NULL) && (node != NULL); arg = next, node = node->next) {
+    next = arg->next;
+    arg->next = NULL;
+    param = node->object;
+    if (param->paramAttrs.kind == PARAM_VALUE) {
+      temp = createTemporaryObject(scope, param->paramAttrs.type);
+      addReplacement(&site, param, temp, NULL, 1);
+      appendStatement(&first, &last, makeAssignStatement(makeLValue(temp, NULL, param->paramAttrs.type), arg));
+    } else if ((arg->lvalue->object != NULL) && (arg->lvalue->indexes == NULL) &&
+	       ((arg->lvalue->object->kind == OBJ_VARIABLE) || (arg->lvalue->object->kind == OBJ_PARAMETER))) {
+      addReplacement(&site, param, arg->lvalue->object, NULL, 0);
+    } else {
+      temp = createTemporaryObject(scope, intType);
+      addReplacement(&site, param, NULL, temp, 1);
+      appendStatement(&first, &last, makeAssignStatement(makeLValue(temp, NULL, intType), arg));
+    }
+  }
+
+  if (callee->kind == OBJ_FUNCTION) {
+    temp = createTemporaryObject(scope, callee->funcAttrs.returnType);
+    addReplacement(&site, callee, temp, NULL, 1);
+    *value = makeVariableExpression(makeLValue(temp, NULL, callee->funcAttrs.returnType));
+  }
+
+  if (last == NULL)
+    first = last = copyStatements(&site, sub->block->body);
+  else last->next = copyStatements(&site, sub->block->body);
+  *pure = isPureStatement(&site, first);
+  free(site.replacements);
+  return first;
+}
+
+void inlineSubprogram(Inliner* inliner, Subprogram* sub);
+
+// Whether a call to callee may be replaced by its body; its own calls
+// are inlined first
+Subprogram* inlinableSubprogram(Inliner* inliner, Object* callee, int inExpression) {
+  Subprogram* sub = findSubprogram(inliner, callee);
+
+  if (sub == NULL)
+    return NULL;
+  if (sub->state == SUB_NEW)
+    inlineSubprogram(inliner, sub);
+  if (sub->state == SUB_BUSY) {
+    sub->recursive = 1;
+    return NULL;
+  }
+  if (sub->recursive || (sub->block->subBlocks != NULL))
+    return NULL;
+  if (inExpression && hasLoop(sub->block->body))
+    return NULL;
+  if (statementsSize(sub->block->body) > INLINE_MAXIMUM_SIZE)
+    return NULL;
+  return sub;
+}
+
+void inlineExpression(Inliner* inliner, Scope* scope, Expression* exp);
+void inlineStatement(Inliner* inliner, Scope* scope, Statement* st);
+
+void inlineLValue(Inliner* inliner, Scope* scope, LValue* lvalue) {
+  Expression* index;
+
+  if (lvalue->object == NULL)
+    inlineExpression(inliner, scope, lvalue->address);
+  for (index = lvalue->indexes; index != NULL; index = index->next)
+    inlineExpression(inliner, scope, index);
+}
+
+void inlineExpression(Inliner* inliner, Scope* scope, Expression* exp) {
+  Subprogram* sub;
+  Expression* arg;
+  Expression* next;
+  Expression* value;
+  Statement* body;
+  Chain chain;
+  int pure, i;
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    inlineLValue(inliner, scope, exp->lvalue);
+    break;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      inlineExpression(inliner, scope, arg);
+    if (isPredefinedFunction(exp->call.function))
+      break;
+    sub = inlinableSubprogram(inliner, exp->call.function, 1);
+    if (sub != NULL) {
+      body = expandCall(scope, sub, exp->call.arguments, &value, &pure);
+      next = exp->next;
+      *exp = *makeInlineExpression(makeGroupStatement(body), value, pure);
+      exp->next = next;
+    }
+    break;
+  case EXP_NEGATE:
+    inlineExpression(inliner, scope, exp->operand);
+    break;
+  case EXP_BINARY:
+    openChain(&chain, exp);
+    inlineExpression(inliner, scope, chain.nodes[chain.count - 1]->binary.left);
+    for (i = chain.count - 1; i >= 0; i --)
+      inlineExpression(inliner, scope, chain.nodes[i]->binary.right);
+    closeChain(&chain);
+    break;
+  case EXP_SAVE:
+    inlineExpression(inliner, scope, exp->save.operand);
+    break;
+  case EXP_INLINE:
+    inlineStatement(inliner, scope, exp->inlined.body);
+    inlineExpression(inliner, scope, exp->inlined.value);
+    break;
+  default:
+    break;
+  }
+}
+
+void inlineStatement(Inliner* inliner, Scope* scope, Statement* st) {
+  Subprogram* sub;
+  Expression* arg;
+  Expression* value;
+  Statement* s;
+  int pure;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    inlineLValue(inliner, scope, st->assign.lvalue);
+    inlineExpression(inliner, scope, st->assign.value);
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      inlineExpression(inliner, scope, arg);
+    if (isPredefinedProcedure(st->call.procedure))
+      break;
+    sub = inlinableSubprogram(inliner, st->call.procedure, 0);
+    if (sub != NULL) {
+      s = expandCall(scope, sub, st->call.arguments, &value, &pure);
+      st->kind = ST_GROUP;
+      st->body = s;
+    }
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      inlineStatement(inliner, scope, s);
+    break;
+  case ST_IF:
+    inlineExpression(inliner, scope, st->ifSt.condition);
+    inlineStatement(inliner, scope, st->ifSt.thenPart);
+    inlineStatement(inliner, scope, st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+    inlineExpression(inliner, scope, st->whileSt.condition);
+    inlineStatement(inliner, scope, st->whileSt.body);
+    break;
+  case ST_FOR:
+    inlineLValue(inliner, scope, st->forSt.variable);
+    inlineExpression(inliner, scope, st->forSt.from);
+    inlineExpression(inliner, scope, st->forSt.to);
+    inlineStatement(inliner, scope, st->forSt.body);
+    break;
+  }
+}
+
+void inlineSubprogram(Inliner* inliner, Subprogram* sub) {
+  Statement* st;
+
+  sub->state = SUB_BUSY;
+  for (st = sub->block->body; st != NULL; st = st->next)
+    inlineStatement(inliner, sub->block->scope, st);
+  sub->state = SUB_DONE;
+}
+
+/******************* Dropping subprograms ******************************/
+
+void reachSubprogram(Inliner* inliner, Subprogram* sub);
+void reachStatement(Inliner* inliner, Statement* st);
+
+void reachExpression(Inliner* inliner, Expression* exp) {
+  Subprogram* sub;
+  Expression* index;
+  Expression* operand;
+
+  for (; exp != NULL; exp = exp->next)
+    switch (exp->kind) {
+    case EXP_VARIABLE:
+    case EXP_REFERENCE:
+      if (exp->lvalue->object == NULL)
+	reachExpression(inliner, exp->lvalue->address);
+      for (index = exp->lvalue->indexes; index != NULL; index = index->next)
+	reachExpression(inliner, index);
+      break;
+    case EXP_CALL:
+      sub = findSubprogram(inliner, exp->call.function);
+      if (sub != NULL)
+	reachSubprogram(inliner, sub);
+      reachExpression(inliner, exp->call.arguments);
+      break;
+    case EXP_NEGATE:
+      reachExpression(inliner, exp->operand);
+      break;
+    case EXP_BINARY:
+      for (operand = exp; operand->kind == EXP_BINARY; operand = operand->binary.left)
+	reachExpression(inliner, operand->binary.right);
+      reachExpression(inliner, operand);
+      break;
+    case EXP_SAVE:
+      reachExpression(inliner, exp->save.operand);
+      break;
+    case EXP_INLINE:
+      reachStatement(inliner, exp->inlined.body);
+      reachExpression(inliner, exp->inlined.value);
+      break;
+    default:
+      break;
+    }
+}
+
+void reachLValue(Inliner* inliner, LValue* lvalue) {
+  if (lvalue->object == NULL)
+    reachExpression(inliner, lvalue->address);
+  else reachExpression(inliner, lvalue->indexes);
+}
+
+void reachStatement(Inliner* inliner, Statement* st) {
+  Subprogram* sub;
+
+  for (; st != NULL; st = st->next)
+    switch (st->kind) {
+    case ST_ASSIGN:
+      reachLValue(inliner, st->assign.lvalue);
+      reachExpression(inliner, st->assign.value);
+      break;
+    case ST_CALL:
+      sub = findSubprogram(inliner, st->call.procedure);
+      if (sub != NULL)
+	reachSubprogram(inliner, sub);
+      reachExpression(inliner, st->call.arguments);
+      break;
+    case ST_GROUP:
+      reachStatement(inliner, st->body);
+      break;
+    case ST_IF:
+      reachExpression(inliner, st->ifSt.condition);
+      reachStatement(inliner, st->ifSt.thenPart);
+      reachStatement(inliner, st->ifSt.elsePart);
+      break;
+    case ST_WHILE:
+      reachExpression(inliner, st->whileSt.condition);
+      reachStatement(inliner, st->whileSt.body);
+      break;
+    case ST_FOR:
+      reachLValue(inliner, st->forSt.variable);
+      reachExpression(inliner, st->forSt.from);
+      reachExpression(inliner, st->forSt.to);
+      reachStatement(inliner, st->forSt.body);
+      break;
+    }
+}
+
+void reachSubprogram(Inliner* inliner, Subprogram* sub) {
+  if (sub->reached)
+    return;
+  sub->reached = 1;
+  reachStatement(inliner, sub->block->body);
+}
+
+void dropBlock(Block* parent, Block* block) {
+  Block** link = &(parent->subBlocks);
+
+  while (*link != block)
+    link = &((*link)->next);
+  *link = block->next;
+}
+
+/******************* Driver ******************************/
+
+void inlineProgram(Block* program) {
+  Inliner inliner;
+  int i;
+
+  inliner.subprograms = NULL;
+  inliner.count = inliner.capacity = 0;
+  listSubprograms(&inliner, program, NULL);
+
+  for (i = 0; i < inliner.count; i ++)
+    if (inliner.subprograms[i].state == SUB_NEW)
+      inlineSubprogram(&inliner, inliner.subprograms + i);
+
+  reachSubprogram(&inliner, inliner.subprograms);
+  for (i = 1; i < inliner.count; i ++)
+    if (!inliner.subprograms[i].reached)
+      dropBlock(inliner.subprograms[i].parent, inliner.subprograms[i].block);
+  free(inliner.subprograms);
+}
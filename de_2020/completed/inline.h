@@ -0,0 +1,11 @@
+/* Inliner */
+
+#ifndef __INLINE_H__
+#define __INLINE_H__
+
+#include "ast.h"
+
+// Replaces calls to small subprograms of program by their bodies
+void inlineProgram(Block* program);
+
+#endif
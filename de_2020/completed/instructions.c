@@ -66,6 +66,9 @@ int emitGT(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_GT, DC_VALUE, D
 int emitLT(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LT, DC_VALUE, DC_VALUE); }
 int emitGE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_GE, DC_VALUE, DC_VALUE); }
 int emitLE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LE, DC_VALUE, DC_VALUE); }
+int emitFORPREP(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_FORPREP, p, q); }
+int emitFORLOOP(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_FORLOOP, p, q); }
+int emitTJ(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_TJ, DC_VALUE, q); }
 
 int emitBP(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_BP, DC_VALUE, DC_VALUE); }
 
@@ -103,6 +106,9 @@ void printInstruction(Instruction* inst) {
   case OP_LT: printf("LT"); break;
   case OP_GE: printf("GE"); break;
   case OP_LE: printf("LE"); break;
+  case OP_FORPREP: printf("FORPREP %d,%d", inst->p, inst->q); break;
+  case OP_FORLOOP: printf("FORLOOP %d,%d", inst->p, inst->q); break;
+  case OP_TJ: printf("TJ %d", inst->q); break;
 
   case OP_BP: printf("BP"); break;
   default: break;
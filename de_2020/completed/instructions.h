@@ -49,6 +49,9 @@ enum OpCode {
   OP_LT,   // Less             t := t - 1;  if s[t] < s[t+1] then s[t] := 1 else s[t] := 0;
   OP_GE,   // Greater or Equal t := t - 1;  if s[t] >= s[t+1] then s[t] := 1 else s[t] := 0;
   OP_LE,   // Less or Equal    t := t - 1;  if s[t] >= s[t+1] then s[t] := 1 else s[t] := 0;
+  OP_FORPREP, // For Prepare   if s[s[t]] > s[b+p] then begin pc := q; t := t - 1 end;
+  OP_FORLOOP, // For Loop      s[s[t]] := s[s[t]] + 1; if s[s[t]] <= s[b+p] then pc := q else t := t - 1;
+  OP_TJ,   // True Jump        if s[t] != 0 then pc := q; t := t - 1;
 
   OP_BP    // Break point. Just for debugging
 };
@@ -106,6 +109,9 @@ int emitGT(CodeBlock* codeBlock);
 int emitLT(CodeBlock* codeBlock);
 int emitGE(CodeBlock* codeBlock);
 int emitLE(CodeBlock* codeBlock);
+int emitFORPREP(CodeBlock* codeBlock, WORD p, WORD q);
+int emitFORLOOP(CodeBlock* codeBlock, WORD p, WORD q);
+int emitTJ(CodeBlock* codeBlock, WORD q);
 
 int emitBP(CodeBlock* codeBlock);
 
@@ -8,64 +8,283 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(NO_THREADS) && !defined(_WIN32) && defined(__GNUC__) && (__GNUC__ >= 5)
+  #define PARALLEL_BUILD 1
+  #include <pthread.h>
+  #include <unistd.h>
+#else
+  #define PARALLEL_BUILD 0
+#endif
+
 #include "reader.h"
 #include "parser.h"
 #include "codegen.h"
+#include "cache.h"
+#include "optimize.h"
+#include "native.h"
 
 
 int dumpCode = 0;
+int scanInThread = 0;
+int optimizeLevel = DEFAULT_OPTIMIZE_LEVEL;
+int workerCount = 0;            // 0: one per processor
+char *manifestName = NULL;
+char *cacheDir = NULL;          // NULL: no executable cache
+int outputFormat = OUTPUT_VM;
+
+// One input/output pair. Jobs are compiled by a pool of workers, each
+// taking the next job in turn, and reported in order afterwards.
+struct Job_ {
+  char *input;
+  char *output;
+  CompileResult* result;        // NULL if the input cannot be read or was cached
+  int cached;                   // the output was copied from the cache
+  int written;                  // IO_SUCCESS once the output is saved
+};
+
+typedef struct Job_ Job;
+
+Job* jobs = NULL;
+int jobCount = 0;
+int jobCapacity = 0;
+int nextJob = 0;
+CompileOptions options;
 
 void printUsage(void) {
-  printf("Usage: kplc input output [-dump]\n");
+  printf("Usage: kplc input output {input output} [-manifest=file] [-j=workers] [-cache=dir] [-O<level>] [-S] [-native] [-dump] [-pipeline]\n");
   printf("   input: input kpl program\n");
   printf("   output: executable\n");
+  printf("   -manifest=file: also compile the input output pairs listed in file\n");
+  printf("   -j=workers: compile that many programs at a time (default: one per processor)\n");
+  printf("   -cache=dir: reuse executables compiled before (default: $%s)\n", CACHE_ENVIRONMENT);
+  printf("   -O<level>: optimize, 0 for none, 1 for constant folding and peephole (the default) or 2 for inlining and SSA as well\n");
+  printf("   -S: write x86-64 assembly instead of an executable\n");
+  printf("   -native: build an x86-64 executable with $%s (default: cc)\n", NATIVE_CC_ENVIRONMENT);
   printf("   -dump: code dump\n");
+  printf("   -pipeline: scan on a separate thread\n");
 }
 
 int analyseParam(char* param) {
   if (strcmp(param, "-dump") == 0) {
     dumpCode = 1;
     return 1;
-  } 
+  } else if (strcmp(param, "-pipeline") == 0) {
+    scanInThread = 1;
+    return 1;
+  } else if (strcmp(param, "-S") == 0) {
+    outputFormat = OUTPUT_ASSEMBLY;
+    return 1;
+  } else if (strcmp(param, "-native") == 0) {
+    outputFormat = OUTPUT_NATIVE;
+    return 1;
+  } else if (strncmp(param, "-O", 2) == 0) {
+    optimizeLevel = atoi(param + 2);
+    return 1;
+  } else if (strncmp(param, "-j=", 3) == 0) {
+    workerCount = atoi(param + 3);
+    return 1;
+  } else if (strncmp(param, "-cache=", 7) == 0) {
+    cacheDir = param + 7;
+    return 1;
+  } else if (strncmp(param, "-manifest=", 10) == 0) {
+    manifestName = param + 10;
+    return 1;
+  }
   return 0;
 }
 
+void addJob(char *input, char *output) {
+  if (jobCount == jobCapacity) {
+    jobCapacity = (jobCapacity == 0) ? 16 : jobCapacity * 2;
+    jobs = (Job*) realloc(jobs, jobCapacity * sizeof(Job));
+  }
+  jobs[jobCount].input = input;
+  jobs[jobCount].output = output;
+  jobs[jobCount].result = NULL;
+  jobs[jobCount].cached = 0;
+  jobs[jobCount].written = IO_ERROR;
+  jobCount ++;
+}
+
+// A manifest lists input output pairs separated by blanks
+int readManifest(char *fileName) {
+  FILE* f = fopen(fileName, "r");
+  char input[1024], output[1024];
+
+  if (f == NULL) return IO_ERROR;
+  while (fscanf(f, "%1023s %1023s", input, output) == 2)
+    addJob(strdup(input), strdup(output));
+  fclose(f);
+  return IO_SUCCESS;
+}
+
+// With a cache, an unchanged program is copied from it instead of being
+// compiled again (unless its code is to be dumped). The cache only holds
+// executables for kplrun. The source that is hashed is the one compiled.
+void runJob(Job* job) {
+  char key[CACHE_KEY_LENGTH];
+  char *source = NULL;
+  int length;
+  int keyed;
+
+  if ((cacheDir != NULL) && (outputFormat == OUTPUT_VM))
+    source = fileKey(job->input, &options, key, &length);
+  keyed = (source != NULL);
+
+  if (keyed && !dumpCode && (fetchCached(cacheDir, key, job->output) == IO_SUCCESS)) {
+    free(source);
+    job->cached = 1;
+    job->written = IO_SUCCESS;
+    return;
+  }
+
+  if (keyed) {
+    job->result = compileSource(source, length, &options);
+    free(source);
+  } else job->result = compileFile(job->input, &options);
+  if ((job->result != NULL) && (job->result->code != NULL)) {
+    switch (outputFormat) {
+    case OUTPUT_ASSEMBLY:
+      job->written = saveAssembly(job->result->code, job->output);
+      break;
+    case OUTPUT_NATIVE:
+      job->written = buildNative(job->result->code, job->output);
+      break;
+    default:
+      job->written = serialize(job->result->code, job->output);
+      break;
+    }
+    if (keyed && (job->written == IO_SUCCESS))
+      storeCached(cacheDir, key, job->result->code);
+  }
+}
+
+#if PARALLEL_BUILD
+
+void* worker(void* arg) {
+  int i;
+
+  while ((i = __atomic_fetch_add(&nextJob, 1, __ATOMIC_RELAXED)) < jobCount)
+    runJob(jobs + i);
+  return arg;
+}
+
+void runJobs(void) {
+  pthread_t* threads;
+  int count = workerCount;
+  int started = 0;
+
+  if (count <= 0)
+    count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (count > jobCount)
+    count = jobCount;
+  if (count <= 1) {
+    worker(NULL);
+    return;
+  }
+
+  threads = (pthread_t*) malloc(count * sizeof(pthread_t));
+  while ((started < count) && (pthread_create(threads + started, NULL, worker, NULL) == 0))
+    started ++;
+  worker(NULL);
+  while (started > 0)
+    pthread_join(threads[-- started], NULL);
+  free(threads);
+}
+
+#else
+
+void runJobs(void) {
+  for (nextJob = 0; nextJob < jobCount; nextJob ++)
+    runJob(jobs + nextJob);
+}
+
+#endif
+
+// Reports a job the way a single compilation always has; with several
+// jobs every line is prefixed by the input's name
+int reportJob(Job* job) {
+  CompileResult* result = job->result;
+  char *prefix = (jobCount > 1) ? job->input : (char*) "";
+  char *separator = (jobCount > 1) ? (char*) ": " : (char*) "";
+  int i;
+
+  if (job->cached)
+    return IO_SUCCESS;
+
+  if (result == NULL) {
+    printf("%s%sCan\'t read input file!\n", prefix, separator);
+    return IO_ERROR;
+  }
+
+  if (result->diagnosticCount > 0) {
+    for (i = 0; i < result->diagnosticCount; i ++)
+      printf("%s%s%d-%d:%s\n", prefix, separator, result->diagnostics[i].lineNo,
+	     result->diagnostics[i].colNo, result->diagnostics[i].message);
+    return IO_SUCCESS;
+  }
+
+  if (job->written == IO_ERROR) {
+    printf("%s%sCan\'t write output file!\n", prefix, separator);
+    return IO_ERROR;
+  }
+
+  if (dumpCode) {
+    if (jobCount > 1) printf("%s:\n", job->input);
+    printCodeBlock(result->code);
+  }
+  return IO_SUCCESS;
+}
+
 
 /******************************************************************/
 
 int main(int argc, char *argv[]) {
+  char *input = NULL;
+  int status = 0;
   int i; 
 
-  if (argc <= 1) {
+  for (i = 1; i < argc; i ++) {
+    if (analyseParam(argv[i]))
+      continue;
+    if (input == NULL)
+      input = argv[i];
+    else {
+      addJob(input, argv[i]);
+      input = NULL;
+    }
+  }
+
+  if ((manifestName != NULL) && (readManifest(manifestName) == IO_ERROR)) {
+    printf("kplc: can\'t read manifest %s.\n", manifestName);
+    return -1;
+  }
+
+  if ((jobCount == 0) && (input == NULL)) {
     printf("kplc: no input file.\n");
     printUsage();
     return -1;
   }
 
-  if (argc <= 2) {
+  if (input != NULL) {
     printf("kplc: no output file.\n");
     printUsage();
     return -1;
   }
 
-  for ( i = 3; i < argc; i ++) 
-    analyseParam(argv[i]);
+  if (cacheDir == NULL)
+    cacheDir = defaultCacheDirectory(0);
+  options.scanInThread = scanInThread;
+  options.optimizeLevel = optimizeLevel;
+  runJobs();
 
-  initCodeBuffer();
-
-  if (compile(argv[1]) == IO_ERROR) {
-    printf("Can\'t read input file!\n");
-    return -1;
+  for (i = 0; i < jobCount; i ++) {
+    if (reportJob(jobs + i) == IO_ERROR)
+      status = -1;
+    if (jobs[i].result != NULL)
+      freeCompileResult(jobs[i].result);
   }
+  free(jobs);
 
-  if (serialize(argv[2]) == IO_ERROR) {
-    printf("Can\'t write output file!\n");
-    return -1;
-  }
-
-  if (dumpCode) printCodeBuffer();
-    
-  cleanCodeBuffer();
-
-  return 0;
+  return status;
 }
@@ -0,0 +1,345 @@
+/* Native code: x86-64 assembly from VM code */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reader.h"
+#include "native.h"
+
+#ifdef _WIN32
+  #define popen _popen
+  #define pclose _pclose
+#else
+  #include <signal.h>
+#endif
+
+// The code of a program is translated instruction by instruction into
+// x86-64 assembly for the System V ABI. The program keeps the memory of
+// the VM: its stack is an array of words, t and b index it, and a frame
+// has the same result, dynamic link, return address and static link
+// words, so base(p) follows the same chain of static links. CALL also
+// pushes a native return address, which EP and EF return to. A small
+// runtime, written out with the code, reads and writes through the C
+// library in the formats kplrun uses.
+//
+// %rbx holds the address of the stack, %r12 holds t and %r13 holds b.
+// The C library saves them across calls.
+
+#define TOP "(%%rbx,%%r12,4)"
+#define BELOW "-4(%%rbx,%%r12,4)"
+
+// Leaves base(p) in %rax
+void writeBase(FILE* f, WORD p) {
+  fprintf(f, "\tmovq %%r13, %%rax\n");
+  for (; p > 0; p --)
+    fprintf(f, "\tmovslq 12(%%rbx,%%rax,4), %%rax\n");
+}
+
+void writeCompare(FILE* f, char* condition) {
+  fprintf(f, "\tmovl " TOP ", %%eax\n");
+  fprintf(f, "\tdecq %%r12\n");
+  fprintf(f, "\txorl %%ecx, %%ecx\n");
+  fprintf(f, "\tcmpl %%eax, " TOP "\n");
+  fprintf(f, "\tset%s %%cl\n", condition);
+  fprintf(f, "\tmovl %%ecx, " TOP "\n");
+}
+
+void writeInstruction(FILE* f, Instruction* inst, int pc) {
+  switch (inst->op) {
+  case OP_LA:
+    writeBase(f, inst->p);
+    fprintf(f, "\taddq $%d, %%rax\n", inst->q);
+    fprintf(f, "\tincq %%r12\n");
+    fprintf(f, "\tmovl %%eax, " TOP "\n");
+    break;
+  case OP_LV:
+    writeBase(f, inst->p);
+    fprintf(f, "\tmovl %d(%%rbx,%%rax,4), %%ecx\n", 4 * inst->q);
+    fprintf(f, "\tincq %%r12\n");
+    fprintf(f, "\tmovl %%ecx, " TOP "\n");
+    break;
+  case OP_LC:
+    fprintf(f, "\tincq %%r12\n");
+    fprintf(f, "\tmovl $%d, " TOP "\n", inst->q);
+    break;
+  case OP_LI:
+    fprintf(f, "\tmovslq " TOP ", %%rax\n");
+    fprintf(f, "\tmovl (%%rbx,%%rax,4), %%ecx\n");
+    fprintf(f, "\tmovl %%ecx, " TOP "\n");
+    break;
+  case OP_INT:
+    fprintf(f, "\taddq $%d, %%r12\n", inst->q);
+    fprintf(f, "\tcmpq $%d, %%r12\n", NATIVE_STACK_SIZE - NATIVE_STACK_MARGIN);
+    fprintf(f, "\tjg kpl_stack_overflow\n");
+    break;
+  case OP_DCT:
+    fprintf(f, "\tsubq $%d, %%r12\n", inst->q);
+    break;
+  case OP_J:
+    fprintf(f, "\tjmp .L%d\n", inst->q);
+    break;
+  case OP_FJ:
+  case OP_TJ:
+    fprintf(f, "\tmovl " TOP ", %%eax\n");
+    fprintf(f, "\tdecq %%r12\n");
+    fprintf(f, "\ttestl %%eax, %%eax\n");
+    fprintf(f, "\t%s .L%d\n", (inst->op == OP_FJ) ? "jz" : "jnz", inst->q);
+    break;
+  case OP_HL:
+    fprintf(f, "\tjmp kpl_halt\n");
+    break;
+  case OP_ST:
+    fprintf(f, "\tmovslq " BELOW ", %%rax\n");
+    fprintf(f, "\tmovl " TOP ", %%ecx\n");
+    fprintf(f, "\tmovl %%ecx, (%%rbx,%%rax,4)\n");
+    fprintf(f, "\tsubq $2, %%r12\n");
+    break;
+  case OP_CALL:
+    writeBase(f, inst->p);
+    fprintf(f, "\tmovl %%r13d, 8(%%rbx,%%r12,4)\n");
+    fprintf(f, "\tmovl $%d, 12(%%rbx,%%r12,4)\n", pc);
+    fprintf(f, "\tmovl %%eax, 16(%%rbx,%%r12,4)\n");
+    fprintf(f, "\tleaq 1(%%r12), %%r13\n");
+    fprintf(f, "\tcall .L%d\n", inst->q);
+    break;
+  case OP_EP:
+  case OP_EF:
+    if (inst->op == OP_EP)
+      fprintf(f, "\tleaq -1(%%r13), %%r12\n");
+    else fprintf(f, "\tmovq %%r13, %%r12\n");
+    fprintf(f, "\tmovslq 4(%%rbx,%%r13,4), %%r13\n");
+    fprintf(f, "\tret\n");
+    break;
+  case OP_RC:
+  case OP_RI:
+    fprintf(f, "\tcall %s\n", (inst->op == OP_RC) ? "kpl_readc" : "kpl_readi");
+    fprintf(f, "\tincq %%r12\n");
+    fprintf(f, "\tmovl %%eax, " TOP "\n");
+    break;
+  case OP_WRC:
+  case OP_WRI:
+    fprintf(f, "\tmovl " TOP ", %%edi\n");
+    fprintf(f, "\tdecq %%r12\n");
+    fprintf(f, "\tcall %s\n", (inst->op == OP_WRC) ? "kpl_writec" : "kpl_writei");
+    break;
+  case OP_WLN:
+    fprintf(f, "\tcall kpl_writeln\n");
+    break;
+  case OP_AD:
+  case OP_SB:
+    fprintf(f, "\tmovl " TOP ", %%eax\n");
+    fprintf(f, "\tdecq %%r12\n");
+    fprintf(f, "\t%s %%eax, " TOP "\n", (inst->op == OP_AD) ? "addl" : "subl");
+    break;
+  case OP_ML:
+    fprintf(f, "\tmovl " BELOW ", %%eax\n");
+    fprintf(f, "\timull " TOP ", %%eax\n");
+    fprintf(f, "\tdecq %%r12\n");
+    fprintf(f, "\tmovl %%eax, " TOP "\n");
+    break;
+  case OP_DV:
+    fprintf(f, "\tmovl " TOP ", %%ecx\n");
+    fprintf(f, "\ttestl %%ecx, %%ecx\n");
+    fprintf(f, "\tjz kpl_divide_by_zero\n");
+    fprintf(f, "\tdecq %%r12\n");
+    fprintf(f, "\tmovl " TOP ", %%eax\n");
+    fprintf(f, "\tcltd\n");
+    fprintf(f, "\tidivl %%ecx\n");
+    fprintf(f, "\tmovl %%eax, " TOP "\n");
+    break;
+  case OP_PW:
+    fprintf(f, "\tmovl " TOP ", %%esi\n");
+    fprintf(f, "\tdecq %%r12\n");
+    fprintf(f, "\tmovl " TOP ", %%edi\n");
+    fprintf(f, "\tcall kpl_power\n");
+    fprintf(f, "\tmovl %%eax, " TOP "\n");
+    break;
+  case OP_NEG:
+    fprintf(f, "\tnegl " TOP "\n");
+    break;
+  case OP_CV:
+    fprintf(f, "\tmovl " TOP ", %%eax\n");
+    fprintf(f, "\tincq %%r12\n");
+    fprintf(f, "\tmovl %%eax, " TOP "\n");
+    break;
+  case OP_EQ: writeCompare(f, (char*) "e"); break;
+  case OP_NE: writeCompare(f, (char*) "ne"); break;
+  case OP_GT: writeCompare(f, (char*) "g"); break;
+  case OP_LT: writeCompare(f, (char*) "l"); break;
+  case OP_GE: writeCompare(f, (char*) "ge"); break;
+  case OP_LE: writeCompare(f, (char*) "le"); break;
+  case OP_FORPREP:
+    fprintf(f, "\tmovslq " TOP ", %%rax\n");
+    fprintf(f, "\tmovl (%%rbx,%%rax,4), %%ecx\n");
+    fprintf(f, "\tcmpl %d(%%rbx,%%r13,4), %%ecx\n", 4 * inst->p);
+    fprintf(f, "\tjle .L%d\n", pc + 1);
+    fprintf(f, "\tdecq %%r12\n");
+    fprintf(f, "\tjmp .L%d\n", inst->q);
+    break;
+  case OP_FORLOOP:
+    fprintf(f, "\tmovslq " TOP ", %%rax\n");
+    fprintf(f, "\tmovl (%%rbx,%%rax,4), %%ecx\n");
+    fprintf(f, "\tincl %%ecx\n");
+    fprintf(f, "\tmovl %%ecx, (%%rbx,%%rax,4)\n");
+    fprintf(f, "\tcmpl %d(%%rbx,%%r13,4), %%ecx\n", 4 * inst->p);
+    fprintf(f, "\tjle .L%d\n", inst->q);
+    fprintf(f, "\tdecq %%r12\n");
+    break;
+  default:
+    break;
+  }
+}
+
+// Calls into the C library realign the machine stack, whose depth
+// follows the calls of the program
+void writeLibraryCall(FILE* f, char* function) {
+  fprintf(f, "\tpushq %%rbp\n");
+  fprintf(f, "\tmovq %%rsp, %%rbp\n");
+  fprintf(f, "\tandq $-16, %%rsp\n");
+  fprintf(f, "\txorl %%eax, %%eax\n");
+  fprintf(f, "\tcall %s@PLT\n", function);
+  fprintf(f, "\tmovq %%rbp, %%rsp\n");
+  fprintf(f, "\tpopq %%rbp\n");
+}
+
+void writeRuntime(FILE* f) {
+  fprintf(f, "kpl_readc:\n");
+  fprintf(f, "\tleaq kpl_format_char(%%rip), %%rdi\n");
+  fprintf(f, "\tjmp kpl_read\n");
+  fprintf(f, "kpl_readi:\n");
+  fprintf(f, "\tleaq kpl_format_int(%%rip), %%rdi\n");
+  fprintf(f, "kpl_read:\n");
+  fprintf(f, "\tleaq kpl_number(%%rip), %%rsi\n");
+  writeLibraryCall(f, (char*) "scanf");
+  fprintf(f, "\tmovl kpl_number(%%rip), %%eax\n");
+  fprintf(f, "\tret\n");
+
+  fprintf(f, "kpl_writec:\n");
+  fprintf(f, "\tmovl %%edi, %%esi\n");
+  fprintf(f, "\tleaq kpl_format_char(%%rip), %%rdi\n");
+  writeLibraryCall(f, (char*) "printf");
+  fprintf(f, "\tret\n");
+  fprintf(f, "kpl_writei:\n");
+  fprintf(f, "\tmovl %%edi, %%esi\n");
+  fprintf(f, "\tleaq kpl_format_int(%%rip), %%rdi\n");
+  writeLibraryCall(f, (char*) "printf");
+  fprintf(f, "\tret\n");
+  fprintf(f, "kpl_writeln:\n");
+  fprintf(f, "\tleaq kpl_format_line(%%rip), %%rdi\n");
+  writeLibraryCall(f, (char*) "printf");
+  fprintf(f, "\tret\n");
+
+  // %edi ** %esi, as PW computes it
+  fprintf(f, "kpl_power:\n");
+  fprintf(f, "\txorl %%eax, %%eax\n");
+  fprintf(f, "\ttestl %%esi, %%esi\n");
+  fprintf(f, "\tjs 2f\n");
+  fprintf(f, "\tmovl $1, %%eax\n");
+  fprintf(f, "1:\ttestl %%esi, %%esi\n");
+  fprintf(f, "\tjz 2f\n");
+  fprintf(f, "\ttestl $1, %%esi\n");
+  fprintf(f, "\tjz 3f\n");
+  fprintf(f, "\timull %%edi, %%eax\n");
+  fprintf(f, "3:\timull %%edi, %%edi\n");
+  fprintf(f, "\tshrl $1, %%esi\n");
+  fprintf(f, "\tjmp 1b\n");
+  fprintf(f, "2:\tret\n");
+
+  fprintf(f, "kpl_divide_by_zero:\n");
+  fprintf(f, "\tleaq kpl_message_divide(%%rip), %%rdi\n");
+  fprintf(f, "\tjmp kpl_fail\n");
+  fprintf(f, "kpl_stack_overflow:\n");
+  fprintf(f, "\tleaq kpl_message_overflow(%%rip), %%rdi\n");
+  fprintf(f, "kpl_fail:\n");
+  fprintf(f, "\tandq $-16, %%rsp\n");
+  fprintf(f, "\txorl %%eax, %%eax\n");
+  fprintf(f, "\tcall printf@PLT\n");
+  fprintf(f, "\tmovl $1, %%edi\n");
+  fprintf(f, "\tcall exit@PLT\n");
+  fprintf(f, "kpl_halt:\n");
+  fprintf(f, "\tandq $-16, %%rsp\n");
+  fprintf(f, "\txorl %%edi, %%edi\n");
+  fprintf(f, "\tcall exit@PLT\n");
+
+  fprintf(f, "\t.section .rodata\n");
+  fprintf(f, "kpl_format_char:\n\t.string \"%%c\"\n");
+  fprintf(f, "kpl_format_int:\n\t.string \"%%d\"\n");
+  fprintf(f, "kpl_format_line:\n\t.string \"\\n\"\n");
+  fprintf(f, "kpl_message_divide:\n\t.string \"Runtime error: Divide by zero!\\n\"\n");
+  fprintf(f, "kpl_message_overflow:\n\t.string \"Runtime error: Stack overflow!\\n\"\n");
+  fprintf(f, "\t.local kpl_number\n");
+  fprintf(f, "\t.comm kpl_number, 4, 4\n");
+  fprintf(f, "\t.local kpl_stack\n");
+  fprintf(f, "\t.comm kpl_stack, %d, 16\n", NATIVE_STACK_SIZE * (int) sizeof(WORD));
+  fprintf(f, "\t.section .note.GNU-stack,\"\",@progbits\n");
+}
+
+void writeAssembly(CodeBlock* codeBlock, FILE* f) {
+  int pc;
+
+  fprintf(f, "\t.text\n");
+  fprintf(f, "\t.globl main\n");
+  fprintf(f, "\t.type main, @function\n");
+  fprintf(f, "main:\n");
+  fprintf(f, "\tpushq %%rbx\n");
+  fprintf(f, "\tpushq %%r12\n");
+  fprintf(f, "\tpushq %%r13\n");
+  fprintf(f, "\tleaq kpl_stack(%%rip), %%rbx\n");
+  fprintf(f, "\tmovq $-1, %%r12\n");
+  fprintf(f, "\txorl %%r13d, %%r13d\n");
+
+  for (pc = 0; pc < codeBlock->codeSize; pc ++) {
+    fprintf(f, ".L%d:\n", pc);
+    writeInstruction(f, codeBlock->code + pc, pc);
+  }
+  fprintf(f, ".L%d:\n", codeBlock->codeSize);
+  fprintf(f, "\tjmp kpl_halt\n");
+  writeRuntime(f);
+}
+
+int saveAssembly(CodeBlock* codeBlock, char* fileName) {
+  FILE* f;
+
+  f = fopen(fileName, "w");
+  if (f == NULL) return IO_ERROR;
+  writeAssembly(codeBlock, f);
+  return (fclose(f) == 0) ? IO_SUCCESS : IO_ERROR;
+}
+
+// Pipes the assembly into the C compiler driver, which assembles it and
+// links it with the C library
+int buildNative(CodeBlock* codeBlock, char* fileName) {
+  char *cc = getenv(NATIVE_CC_ENVIRONMENT);
+  char *command;
+  char *s;
+  FILE* f;
+  int length;
+
+  if ((cc == NULL) || (*cc == '\0'))
+    cc = (char*) "cc";
+  command = (char*) malloc(strlen(cc) + 4 * strlen(fileName) + 32);
+  length = sprintf(command, "%s -x assembler -o ", cc);
+#ifdef _WIN32
+  length += sprintf(command + length, "\"%s\"", fileName);
+#else
+  // The name is quoted for the shell
+  command[length ++] = '\'';
+  for (s = fileName; *s != '\0'; s ++)
+    if (*s == '\'') {
+      strcpy(command + length, "'\\''");
+      length += 4;
+    } else command[length ++] = *s;
+  command[length ++] = '\'';
+#endif
+  strcpy(command + length, " -");
+
+#ifndef _WIN32
+  // A driver that fails early must not take kplc down with it
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  f = popen(command, "w");
+  free(command);
+  if (f == NULL) return IO_ERROR;
+  writeAssembly(codeBlock, f);
+  return (pclose(f) == 0) ? IO_SUCCESS : IO_ERROR;
+}
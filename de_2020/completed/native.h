@@ -0,0 +1,21 @@
+/* Native code: x86-64 assembly from VM code */
+
+#ifndef __NATIVE_H__
+#define __NATIVE_H__
+
+#include "instructions.h"
+
+// Output formats of kplc
+#define OUTPUT_VM 0                 // an executable for kplrun
+#define OUTPUT_ASSEMBLY 1           // x86-64 assembly for the GNU assembler (-S)
+#define OUTPUT_NATIVE 2             // an x86-64 executable, built by cc (-native)
+
+#define NATIVE_STACK_SIZE (1 << 20) // words of the program's stack
+#define NATIVE_STACK_MARGIN 4096    // words kept free above the last frame
+#define NATIVE_CC_ENVIRONMENT "CC"  // the compiler driver, cc if unset
+
+void writeAssembly(CodeBlock* codeBlock, FILE* f);
+int saveAssembly(CodeBlock* codeBlock, char* fileName);
+int buildNative(CodeBlock* codeBlock, char* fileName);
+
+#endif
@@ -0,0 +1,273 @@
+/* Optimizer: constant folding and purity */
+
+#include <limits.h>
+#include "state.h"
+#include "optimize.h"
+#include "ssa.h"
+#include "inline.h"
+#include "codegen.h"
+
+// Rewrites the tree of a checked program before it is lowered
+void optimizeProgram(Block* program, int level) {
+  if (level >= OPTIMIZE_BASIC)
+    foldBlockConstants(program);
+  if (level >= OPTIMIZE_SSA) {
+    inlineProgram(program);
+    optimizeSSA(program);
+  }
+}
+
+// Rewrites the code generated for a program
+void optimizeCode(CodeBlock* code, int level) {
+  if (level >= OPTIMIZE_BASIC)
+    optimizeCodeBlock(code);
+}
+
+/******************* Constant arithmetic ******************************/
+
+// Set when a folded result does not fit in a word, so the VM's wrapped
+// result differs from the exact one. A declaration clears it before its
+// constant is folded.
+COMPILER_STATE int foldOverflow = 0;
+
+// Whether left ** right, right >= 0, is out of the range of a word
+int powerOverflows(WORD left, WORD right) {
+  long long exact = 1;
+
+  if ((left >= -1) && (left <= 1))
+    return 0;
+  for (; right > 0; right --) {
+    exact *= left;
+    if ((exact > INT_MAX) || (exact < INT_MIN))
+      return 1;
+  }
+  return 0;
+}
+
+// The VM computes on 32-bit words that wrap around; unsigned arithmetic
+// gives the same bits without overflowing in C. Returns 0 (and leaves the
+// operation to the VM) when it would fail: a division by zero, or of the
+// most negative word by -1.
+int foldOperator(TokenType op, WORD left, WORD right, WORD* result) {
+  unsigned int base, power;
+  long long exact;
+
+  switch (op) {
+  case SB_PLUS:
+    *result = (WORD) ((unsigned int) left + (unsigned int) right);
+    exact = (long long) left + right;
+    break;
+  case SB_MINUS:
+    *result = (WORD) ((unsigned int) left - (unsigned int) right);
+    exact = (long long) left - right;
+    break;
+  case SB_TIMES:
+    *result = (WORD) ((unsigned int) left * (unsigned int) right);
+    exact = (long long) left * right;
+    break;
+  case SB_SLASH:
+    if ((right == 0) || ((right == -1) && (left == INT_MIN)))
+      return 0;
+    *result = left / right;
+    return 1;
+  case SB_POWER: // đề 2020 bài 1: như lệnh PW của máy ảo
+    if (right < 0) {
+      *result = 0;
+      return 1;
+    }
+    if (powerOverflows(left, right))
+      foldOverflow = 1;
+    base = (unsigned int) left;
+    power = 1;
+    while (right > 0) {
+      if (right & 1) power *= base;
+      base *= base;
+      right >>= 1;
+    }
+    *result = (WORD) power;
+    return 1;
+  case SB_EQ:
+    *result = (left == right);
+    return 1;
+  case SB_NEQ:
+    *result = (left != right);
+    return 1;
+  case SB_LT:
+    *result = (left < right);
+    return 1;
+  case SB_LE:
+    *result = (left <= right);
+    return 1;
+  case SB_GT:
+    *result = (left > right);
+    return 1;
+  case SB_GE:
+    *result = (left >= right);
+    return 1;
+  default:
+    return 0;
+  }
+  if (exact != *result)
+    foldOverflow = 1;
+  return 1;
+}
+
+WORD foldNegate(WORD value) {
+  if (value == INT_MIN)
+    foldOverflow = 1;
+  return (WORD) (0u - (unsigned int) value);
+}
+
+/******************* Constant folding ******************************/
+
+void foldStatementConstants(Statement* st);
+
+void foldLValueConstants(LValue* lvalue) {
+  Expression* index;
+
+  if (lvalue->object == NULL)
+    foldConstants(lvalue->address);
+  else
+    for (index = lvalue->indexes; index != NULL; index = index->next)
+      foldConstants(index);
+}
+
+// Replaces the parts of exp whose operands are all constants by their
+// values, in place. Returns whether exp itself is now a constant.
+int foldConstants(Expression* exp) {
+  Expression* arg;
+  Expression* node;
+  Chain chain;
+  WORD value;
+  int constant, i;
+
+  switch (exp->kind) {
+  case EXP_CONSTANT:
+    return 1;
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    foldLValueConstants(exp->lvalue);
+    return 0;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      foldConstants(arg);
+    return 0;
+  case EXP_NEGATE:
+    if (!foldConstants(exp->operand))
+      return 0;
+    value = foldNegate(exp->operand->value);
+    break;
+  case EXP_BINARY:
+    // from the first operand up, each operator folded in turn
+    openChain(&chain, exp);
+    constant = foldConstants(chain.nodes[chain.count - 1]->binary.left);
+    for (i = chain.count - 1; i >= 0; i --) {
+      node = chain.nodes[i];
+      if (foldConstants(node->binary.right) && constant &&
+	  foldOperator(node->binary.op, node->binary.left->value, node->binary.right->value, &value)) {
+	node->kind = EXP_CONSTANT;
+	node->value = value;
+      } else constant = 0;
+    }
+    closeChain(&chain);
+    return constant;
+  case EXP_SAVE:
+    foldConstants(exp->save.operand);
+    return 0;
+  case EXP_INLINE:
+    foldStatementConstants(exp->inlined.body);
+    foldConstants(exp->inlined.value);
+    return 0;
+  default:
+    return 0;
+  }
+  exp->kind = EXP_CONSTANT;
+  exp->value = value;
+  return 1;
+}
+
+void foldStatementConstants(Statement* st) {
+  Expression* arg;
+  Statement* s;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    foldLValueConstants(st->assign.lvalue);
+    foldConstants(st->assign.value);
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      foldConstants(arg);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      foldStatementConstants(s);
+    break;
+  case ST_IF:
+    foldConstants(st->ifSt.condition);
+    foldStatementConstants(st->ifSt.thenPart);
+    foldStatementConstants(st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+    foldConstants(st->whileSt.condition);
+    foldStatementConstants(st->whileSt.body);
+    break;
+  case ST_FOR:
+    foldLValueConstants(st->forSt.variable);
+    foldConstants(st->forSt.from);
+    foldConstants(st->forSt.to);
+    foldStatementConstants(st->forSt.body);
+    break;
+  }
+}
+
+// Folds the constants of block and of every subprogram declared in it
+void foldBlockConstants(Block* block) {
+  Statement* st;
+  Block* subBlock;
+
+  for (st = block->body; st != NULL; st = st->next)
+    foldStatementConstants(st);
+  for (subBlock = block->subBlocks; subBlock != NULL; subBlock = subBlock->next)
+    foldBlockConstants(subBlock);
+}
+
+// Whether the operator of a binary expression may fail: a division, unless
+// by a constant other than 0 and -1
+int mayFail(Expression* exp) {
+  return (exp->binary.op == SB_SLASH) &&
+    ((exp->binary.right->kind != EXP_CONSTANT) ||
+     (exp->binary.right->value == 0) || (exp->binary.right->value == -1));
+}
+
+// An expression is pure if evaluating it changes nothing and cannot fail,
+// so it may be dropped or evaluated at another time. Reading memory is
+// pure; calls, and divisions that might fault, are not.
+int isPureExpression(Expression* exp) {
+  Expression* index;
+
+  switch (exp->kind) {
+  case EXP_CONSTANT:
+    return 1;
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    if (exp->lvalue->object == NULL)
+      return isPureExpression(exp->lvalue->address);
+    for (index = exp->lvalue->indexes; index != NULL; index = index->next)
+      if (!isPureExpression(index))
+	return 0;
+    return 1;
+  case EXP_NEGATE:
+    return isPureExpression(exp->operand);
+  case EXP_BINARY:
+    for (; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      if (mayFail(exp) || !isPureExpression(exp->binary.right))
+	return 0;
+    return isPureExpression(exp);
+  case EXP_INLINE:
+    return exp->inlined.pure && isPureExpression(exp->inlined.value);
+  default:
+    return 0;
+  }
+}
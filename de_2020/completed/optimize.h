@@ -0,0 +1,25 @@
+/* Optimizer: constant folding and purity */
+
+#ifndef __OPTIMIZE_H__
+#define __OPTIMIZE_H__
+
+#include "ast.h"
+#include "instructions.h"
+
+// Optimization levels, chosen with -O<level>
+#define OPTIMIZE_NONE 0
+#define OPTIMIZE_BASIC 1            // constant folding and the peephole pass
+#define OPTIMIZE_SSA 2              // inlining and the SSA optimizer (ssa.c)
+#define DEFAULT_OPTIMIZE_LEVEL OPTIMIZE_BASIC
+
+void optimizeProgram(Block* program, int level);
+void optimizeCode(CodeBlock* code, int level);
+
+int foldOperator(TokenType op, WORD left, WORD right, WORD* result);
+WORD foldNegate(WORD value);
+int foldConstants(Expression* exp);
+void foldBlockConstants(Block* block);
+int mayFail(Expression* exp);
+int isPureExpression(Expression* exp);
+
+#endif
@@ -5,54 +5,59 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <setjmp.h>
 
+#include "state.h"
 #include "reader.h"
+#include "arena.h"
+#include "strpool.h"
 #include "scanner.h"
 #include "parser.h"
 #include "semantics.h"
 #include "error.h"
 #include "debug.h"
 #include "codegen.h"
+#include "optimize.h"
 
-Token *currentToken;
-Token *lookAhead;
+COMPILER_STATE Token *currentToken;
+COMPILER_STATE Token *lookAhead;
+COMPILER_STATE Arena *compileArena;
 
-extern Type* intType;
-extern Type* charType;
-extern SymTab* symtab;
+extern COMPILER_STATE Type* intType;
+extern COMPILER_STATE Type* charType;
+extern COMPILER_STATE SymTab* symtab;
+extern COMPILER_STATE int foldOverflow;
 
 void scan(void) {
-  Token* tmp = currentToken;
   currentToken = lookAhead;
   lookAhead = getValidToken();
-  free(tmp);
 }
 
 void eat(TokenType tokenType) {
   if (lookAhead->tokenType == tokenType) {
     //    printToken(lookAhead);
     scan();
-  } else missingToken(tokenType, lookAhead->lineNo, lookAhead->colNo);
+  } else missingToken(tokenType, lookAhead->offset);
 }
 
-void compileProgram(void) {
+Block* compileProgram(void) {
   Object* program;
+  Block* block;
 
   eat(KW_PROGRAM);
   eat(TK_IDENT);
 
   program = createProgramObject(currentToken->string);
-  program->progAttrs->codeAddress = getCurrentCodeAddress();
-  enterBlock(program->progAttrs->scope);
+  block = makeBlock(program, program->progAttrs.scope);
+  enterBlock(program->progAttrs.scope);
 
   eat(SB_SEMICOLON);
 
-  compileBlock();
+  compileBlock(block);
   eat(SB_PERIOD);
 
-  genHL();
-
   exitBlock();
+  return block;
 }
 
 void compileConstDecls(void) {
@@ -69,7 +74,7 @@ void compileConstDecls(void) {
       
       eat(SB_EQ);
       constValue = compileConstant();
-      constObj->constAttrs->value = constValue;
+      constObj->constAttrs.value = constValue;
       
       eat(SB_SEMICOLON);
     } while (lookAhead->tokenType == TK_IDENT);
@@ -91,7 +96,7 @@ void compileTypeDecls(void) {
       
       eat(SB_EQ);
       actualType = compileType();
-      typeObj->typeAttrs->actualType = actualType;
+      typeObj->typeAttrs.actualType = actualType;
       
       eat(SB_SEMICOLON);
     } while (lookAhead->tokenType == TK_IDENT);
@@ -110,91 +115,95 @@ void compileVarDecls(void) {
       varObj = createVariableObject(currentToken->string);
       eat(SB_COLON);
       varType = compileType();
-      varObj->varAttrs->type = varType;
+      varObj->varAttrs.type = varType;
       declareObject(varObj);      
       eat(SB_SEMICOLON);
     } while (lookAhead->tokenType == TK_IDENT);
   } 
 }
 
-void compileBlock(void) {
-  Instruction* jmp;
-  
-  jmp = genJ(DC_VALUE);
 
+void compileBlock(Block* block) {
   compileConstDecls();
   compileTypeDecls();
   compileVarDecls();
-  compileSubDecls();
-
-  updateJ(jmp,getCurrentCodeAddress());
-  genINT(symtab->currentScope->frameSize);
+  compileSubDecls(block);
 
   eat(KW_BEGIN);
-  compileStatements();
+  block->body = compileStatements();
   eat(KW_END);
 }
 
-void compileSubDecls(void) {
+void compileSubDecls(Block* block) {
+  Block* last = NULL;
+  Block* subBlock;
+
   while ((lookAhead->tokenType == KW_FUNCTION) || (lookAhead->tokenType == KW_PROCEDURE)) {
     if (lookAhead->tokenType == KW_FUNCTION)
-      compileFuncDecl();
-    else compileProcDecl();
+      subBlock = compileFuncDecl();
+    else subBlock = compileProcDecl();
+
+    if (last == NULL)
+      block->subBlocks = subBlock;
+    else last->next = subBlock;
+    last = subBlock;
   }
 }
 
-void compileFuncDecl(void) {
+Block* compileFuncDecl(void) {
   Object* funcObj;
   Type* returnType;
+  Block* block;
 
   eat(KW_FUNCTION);
   eat(TK_IDENT);
 
   checkFreshIdent(currentToken->string);
   funcObj = createFunctionObject(currentToken->string);
-  funcObj->funcAttrs->codeAddress = getCurrentCodeAddress();
   declareObject(funcObj);
+  block = makeBlock(funcObj, funcObj->funcAttrs.scope);
 
-  enterBlock(funcObj->funcAttrs->scope);
+  enterBlock(funcObj->funcAttrs.scope);
   
   compileParams();
 
   eat(SB_COLON);
   returnType = compileBasicType();
-  funcObj->funcAttrs->returnType = returnType;
+  funcObj->funcAttrs.returnType = returnType;
 
   eat(SB_SEMICOLON);
 
-  compileBlock();
+  compileBlock(block);
 
-  genEF();
   eat(SB_SEMICOLON);
 
   exitBlock();
+  return block;
 }
 
-void compileProcDecl(void) {
+Block* compileProcDecl(void) {
   Object* procObj;
+  Block* block;
 
   eat(KW_PROCEDURE);
   eat(TK_IDENT);
 
   checkFreshIdent(currentToken->string);
   procObj = createProcedureObject(currentToken->string);
-  procObj->procAttrs->codeAddress = getCurrentCodeAddress();
   declareObject(procObj);
+  block = makeBlock(procObj, procObj->procAttrs.scope);
 
-  enterBlock(procObj->procAttrs->scope);
+  enterBlock(procObj->procAttrs.scope);
 
   compileParams();
 
   eat(SB_SEMICOLON);
-  compileBlock();
+  compileBlock(block);
 
-  genEP();
   eat(SB_SEMICOLON);
 
   exitBlock();
+  return block;
 }
 
 ConstantValue* compileUnsignedConstant(void) {
@@ -210,7 +219,7 @@ ConstantValue* compileUnsignedConstant(void) {
     eat(TK_IDENT);
 
     obj = checkDeclaredConstant(currentToken->string);
-    constValue = duplicateConstantValue(obj->constAttrs->value);
+    constValue = duplicateConstantValue(obj->constAttrs.value);
 
     break;
   case TK_CHAR:
@@ -218,58 +227,38 @@ ConstantValue* compileUnsignedConstant(void) {
     constValue = makeCharConstant(currentToken->string[0]);
     break;
   default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_CONSTANT, lookAhead->offset);
     break;
   }
   return constValue;
 }
 
+// A constant is an expression whose value is known when compiling: it
+// may use literals, constants declared before and any operator, but its
+// value must not wrap around as the VM's arithmetic would
 ConstantValue* compileConstant(void) {
-  ConstantValue* constValue;
+  int offset = lookAhead->offset;
+  Expression* exp = compileExpression();
 
-  switch (lookAhead->tokenType) {
-  case SB_PLUS:
-    eat(SB_PLUS);
-    constValue = compileConstant2();
-    break;
-  case SB_MINUS:
-    eat(SB_MINUS);
-    constValue = compileConstant2();
-    constValue->intValue = - constValue->intValue;
-    break;
-  case TK_CHAR:
-    eat(TK_CHAR);
-    constValue = makeCharConstant(currentToken->string[0]);
-    break;
-  default:
-    constValue = compileConstant2();
-    break;
-  }
-  return constValue;
+  foldOverflow = 0;
+  if (!foldConstants(exp))
+    error(ERR_INVALID_CONSTANT, offset);
+  if (foldOverflow)
+    error(ERR_CONSTANT_OVERFLOW, offset);
+  if (exp->type->typeClass == TP_CHAR)
+    return makeCharConstant((char) exp->value);
+  return makeIntConstant(exp->value);
 }
 
-ConstantValue* compileConstant2(void) {
-  ConstantValue* constValue;
-  Object* obj;
+int compileArraySize(void) {
+  int offset = lookAhead->offset;
+  ConstantValue* size = compileConstant();
 
-  switch (lookAhead->tokenType) {
-  case TK_NUMBER:
-    eat(TK_NUMBER);
-    constValue = makeIntConstant(currentToken->value);
-    break;
-  case TK_IDENT:
-    eat(TK_IDENT);
-    obj = checkDeclaredConstant(currentToken->string);
-    if (obj->constAttrs->value->type == TP_INT)
-      constValue = duplicateConstantValue(obj->constAttrs->value);
-    else
-      error(ERR_UNDECLARED_INT_CONSTANT,currentToken->lineNo, currentToken->colNo);
-    break;
-  default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
-    break;
-  }
-  return constValue;
+  if (size->type != TP_INT)
+    error(ERR_TYPE_INCONSISTENCY, offset);
+  if (size->intValue < 0)
+    error(ERR_INVALID_ARRAY_SIZE, offset);
+  return size->intValue;
 }
 
 Type* compileType(void) {
@@ -290,10 +279,7 @@ Type* compileType(void) {
   case KW_ARRAY:
     eat(KW_ARRAY);
     eat(SB_LSEL);
-    eat(TK_NUMBER);
-
-    arraySize = currentToken->value;
-
+    arraySize = compileArraySize();
     eat(SB_RSEL);
     eat(KW_OF);
     elementType = compileType();
@@ -302,10 +288,10 @@ Type* compileType(void) {
   case TK_IDENT:
     eat(TK_IDENT);
     obj = checkDeclaredType(currentToken->string);
-    type = duplicateType(obj->typeAttrs->actualType);
+    type = obj->typeAttrs.actualType;
     break;
   default:
-    error(ERR_INVALID_TYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_TYPE, lookAhead->offset);
     break;
   }
   return type;
@@ -324,7 +310,7 @@ Type* compileBasicType(void) {
     type = makeCharType();
     break;
   default:
-    error(ERR_INVALID_BASICTYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_BASICTYPE, lookAhead->offset);
     break;
   }
   return type;
@@ -357,37 +343,53 @@ void compileParam(void) {
   param = createParameterObject(currentToken->string, paramKind);
   eat(SB_COLON);
   type = compileBasicType();
-  param->paramAttrs->type = type;
+  param->paramAttrs.type = type;
   declareObject(param);
 }
 
-void compileStatements(void) {
-  compileStatement();
+
+// The statements of a group, linked in order; empty ones are left out
+Statement* compileStatements(void) {
+  Statement* first;
+  Statement* last;
+  Statement* st;
+
+  first = last = compileStatement();
   while (lookAhead->tokenType == SB_SEMICOLON) {
     eat(SB_SEMICOLON);
-    compileStatement();
+    st = compileStatement();
+    if (st == NULL)
+      continue;
+    if (last == NULL)
+      first = st;
+    else last->next = st;
+    last = st;
   }
+  return first;
 }
 
-void compileStatement(void) {
+// Returns NULL for an empty statement
+Statement* compileStatement(void) {
+  Statement* st = NULL;
+
   switch (lookAhead->tokenType) {
   case TK_IDENT:
-    compileAssignSt();
+    st = compileAssignSt();
     break;
   case KW_CALL:
-    compileCallSt();
+    st = compileCallSt();
     break;
   case KW_BEGIN:
-    compileGroupSt();
+    st = compileGroupSt();
     break;
   case KW_IF:
-    compileIfSt();
+    st = compileIfSt();
     break;
   case KW_WHILE:
-    compileWhileSt();
+    st = compileWhileSt();
     break;
   case KW_FOR:
-    compileForSt();
+    st = compileForSt();
     break;
     // EmptySt needs to check FOLLOW tokens
   case SB_SEMICOLON:
@@ -396,14 +398,16 @@ void compileStatement(void) {
     break;
     // Error occurs
   default:
-    error(ERR_INVALID_STATEMENT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_STATEMENT, lookAhead->offset);
     break;
   }
+  return st;
 }
 
-Type* compileLValue(void) {
+LValue* compileLValue(void) {
   Object* var;
   Type* varType;
+  Expression* indexes = NULL;
 
   eat(TK_IDENT);
   
@@ -411,189 +415,148 @@ Type* compileLValue(void) {
 
   switch (var->kind) {
   case OBJ_VARIABLE:
-    genVariableAddress(var);
-
-    if (var->varAttrs->type->typeClass == TP_ARRAY) {
-      varType = compileIndexes(var->varAttrs->type);
+    if (var->varAttrs.type->typeClass == TP_ARRAY) {
+      varType = compileIndexes(var->varAttrs.type, &indexes);
     }
     else
-      varType = var->varAttrs->type;
+      varType = var->varAttrs.type;
     break;
   case OBJ_PARAMETER:
-    if (var->paramAttrs->kind == PARAM_VALUE)
-      genParameterAddress(var);
-    else genParameterValue(var);
-
-    varType = var->paramAttrs->type;
+    varType = var->paramAttrs.type;
     break;
   case OBJ_FUNCTION:
-    genReturnValueAddress(var);
-    varType = var->funcAttrs->returnType;
+    varType = var->funcAttrs.returnType;
     break;
   default: 
-    error(ERR_INVALID_LVALUE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_LVALUE,currentToken->offset);
   }
 
-  return varType;
+  return makeLValue(var, indexes, varType);
 }
 
-void compileAssignSt(void) {
-  Type* varType;
-  Type* expType;
+Statement* compileAssignSt(void) {
+  LValue* lvalue;
+  Expression* exp;
 
-  varType = compileLValue();
+  lvalue = compileLValue();
   
   eat(SB_ASSIGN);
-  expType = compileExpression();
-  checkTypeEquality(varType, expType);
+  exp = compileExpression();
+  checkTypeEquality(lvalue->type, exp->type);
 
-  genST();
+  return makeAssignStatement(lvalue, exp);
 }
 
-void compileCallSt(void) {
+Statement* compileCallSt(void) {
   Object* proc;
+  Expression* arguments;
 
   eat(KW_CALL);
   eat(TK_IDENT);
 
   proc = checkDeclaredProcedure(currentToken->string);
-  if (proc == NULL) {
-    if (isPredefinedFunction(proc)){
-      compileArguments(proc->funcAttrs->paramList);
-      genPredefinedFunctionCall(proc);
-    } 
-  }
-  else{
-    if (isPredefinedProcedure(proc)) {
-      compileArguments(proc->procAttrs->paramList);
-      genPredefinedProcedureCall(proc);
-    } else {
-      genINT(RESERVED_WORDS);
-      compileArguments(proc->procAttrs->paramList);
-      genDCT( RESERVED_WORDS + proc->procAttrs->paramCount);
-      genProcedureCall(proc);
-    }
-  }
+  arguments = compileArguments(proc->procAttrs.paramList);
+  return makeCallStatement(proc, arguments);
 }
 
-void compileGroupSt(void) {
+Statement* compileGroupSt(void) {
+  Statement* body;
+
   eat(KW_BEGIN);
-  compileStatements();
+  body = compileStatements();
   eat(KW_END);
+  return makeGroupStatement(body);
 }
 
-void compileIfSt(void) {
-  Instruction* fjInstruction;
-  Instruction* jInstruction;
+Statement* compileIfSt(void) {
+  Expression* condition;
+  Statement* thenPart;
+  Statement* elsePart = NULL;
 
   eat(KW_IF);
-  compileCondition();
+  condition = compileCondition();
   eat(KW_THEN);
 
-  fjInstruction = genFJ(DC_VALUE);
-  compileStatement();
+  thenPart = compileStatement();
   if (lookAhead->tokenType == KW_ELSE) {
-    jInstruction = genJ(DC_VALUE);
-    updateFJ(fjInstruction, getCurrentCodeAddress());
     eat(KW_ELSE);
-    compileStatement();
-    updateJ(jInstruction, getCurrentCodeAddress());
-  } else {
-    updateFJ(fjInstruction, getCurrentCodeAddress());
+    elsePart = compileStatement();
   }
+  return makeIfStatement(condition, thenPart, elsePart);
 }
 
-void compileWhileSt(void) {
-  CodeAddress beginWhile;
-  Instruction* fjInstruction;
+Statement* compileWhileSt(void) {
+  Expression* condition;
+  Statement* body;
 
-  beginWhile = getCurrentCodeAddress();
   eat(KW_WHILE);
-  compileCondition();
-  fjInstruction = genFJ(DC_VALUE);
+  condition = compileCondition();
   eat(KW_DO);
-  compileStatement();
-  genJ(beginWhile);
-  updateFJ(fjInstruction, getCurrentCodeAddress());
+  body = compileStatement();
+  return makeWhileStatement(condition, body);
 }
 
-void compileForSt(void) {
-  CodeAddress beginLoop;
-  Instruction* fjInstruction;
-  Type* varType;
-  Type *type;
+Statement* compileForSt(void) {
+  LValue* variable;
+  Expression* from;
+  Expression* to;
+  Statement* body;
 
   eat(KW_FOR);
 
-  varType = compileLValue();
+  variable = compileLValue();
   eat(SB_ASSIGN);
 
-  genCV();
-  type = compileExpression();
-  checkTypeEquality(varType, type);
-  genST();
-  genCV();
-  genLI();
-  beginLoop = getCurrentCodeAddress();
+  from = compileExpression();
+  checkTypeEquality(variable->type, from->type);
   eat(KW_TO);
 
-  type = compileExpression();
-  checkTypeEquality(varType, type);
-  genLE();
-  fjInstruction = genFJ(DC_VALUE);
+  to = compileExpression();
+  checkTypeEquality(variable->type, to->type);
 
   eat(KW_DO);
-  compileStatement();
-
-  genCV();  
-  genCV();
-  genLI();
-  genLC(1);
-  genAD();
-  genST();
-
-  genCV();
-  genLI();
-
-  genJ(beginLoop);
-  updateFJ(fjInstruction, getCurrentCodeAddress());
-  genDCT(1);
-
+  body = compileStatement();
+  return makeForStatement(variable, from, to, body);
 }
 
-void compileArgument(Object* param) {
-  Type* type;
+Expression* compileArgument(Object* param) {
+  Expression* exp;
 
-  if (param->paramAttrs->kind == PARAM_VALUE) {
-    type = compileExpression();
-    checkTypeEquality(type, param->paramAttrs->type);
+  if (param->paramAttrs.kind == PARAM_VALUE) {
+    exp = compileExpression();
+    checkTypeEquality(exp->type, param->paramAttrs.type);
   } else {
-    type = compileLValue();
-    checkTypeEquality(type, param->paramAttrs->type);
+    exp = makeReferenceExpression(compileLValue());
+    checkTypeEquality(exp->type, param->paramAttrs.type);
   }
+  return exp;
 }
 
-void compileArguments(ObjectNode* paramList) {
+// The arguments, linked in order
+Expression* compileArguments(ObjectNode* paramList) {
   ObjectNode* node = paramList;
+  Expression* first = NULL;
+  Expression* last;
 
   switch (lookAhead->tokenType) {
   case SB_LPAR:
     eat(SB_LPAR);
     if (node == NULL)
-      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
-    compileArgument(node->object);
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
+    first = last = compileArgument(node->object);
     node = node->next;
 
     while (lookAhead->tokenType == SB_COMMA) {
       eat(SB_COMMA);
       if (node == NULL)
-	error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
-      compileArgument(node->object);
+	error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
+      last->next = compileArgument(node->object);
+      last = last->next;
       node = node->next;
     }
 
     if (node != NULL)
-      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
     
     eat(SB_RPAR);
     break;
@@ -620,17 +583,18 @@ void compileArguments(ObjectNode* paramList) {
   case KW_THEN:
     break;
   default:
-    error(ERR_INVALID_ARGUMENTS, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_ARGUMENTS, lookAhead->offset);
   }
+  return first;
 }
 
-void compileCondition(void) {
-  Type* type1;
-  Type* type2;
+Expression* compileCondition(void) {
+  Expression* exp1;
+  Expression* exp2;
   TokenType op;
 
-  type1 = compileExpression();
-  checkBasicType(type1);
+  exp1 = compileExpression();
+  checkBasicType(exp1->type);
 
   op = lookAhead->tokenType;
   switch (op) {
@@ -653,94 +617,39 @@ void compileCondition(void) {
     eat(SB_GT);
     break;
   default:
-    error(ERR_INVALID_COMPARATOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_COMPARATOR, lookAhead->offset);
   }
 
-  type2 = compileExpression();
-  checkTypeEquality(type1,type2);
-
-  switch (op) {
-  case SB_EQ:
-    genEQ();
-    break;
-  case SB_NEQ:
-    genNE();
-    break;
-  case SB_LE:
-    genLE();
-    break;
-  case SB_LT:
-    genLT();
-    break;
-  case SB_GE:
-    genGE();
-    break;
-  case SB_GT:
-    genGT();
-    break;
-  default:
-    break;
-  }
+  exp2 = compileExpression();
+  checkTypeEquality(exp1->type, exp2->type);
 
+  return makeBinaryExpression(op, exp1, exp2);
 }
 
-Type* compileExpression(void) {
-  Type* type;
+Expression* compileExpression(void) {
+  Expression* exp;
   
   switch (lookAhead->tokenType) {
   case SB_PLUS:
     eat(SB_PLUS);
-    type = compileExpression2();
-    checkIntType(type);
+    exp = compileExpression2();
+    checkIntType(exp->type);
     break;
   case SB_MINUS:
     eat(SB_MINUS);
-    type = compileExpression2();
-    checkIntType(type);
-    genNEG();
+    exp = compileExpression2();
+    checkIntType(exp->type);
+    exp = makeNegateExpression(exp);
     break;
   default:
-    type = compileExpression2();
+    exp = compileExpression2();
   }
-  return type;
-}
-
-Type* compileExpression2(void) {
-  Type* type;
-
-  type = compileTerm();
-  type = compileExpression3(type);
-
-  return type;
+  return exp;
 }
 
-
-Type* compileExpression3(Type* argType1) {
-  Type* argType2;
-  Type* resultType;
-
-  switch (lookAhead->tokenType) {
-  case SB_PLUS:
-    eat(SB_PLUS);
-    checkIntType(argType1);
-    argType2 = compileTerm();
-    checkIntType(argType2);
-
-    genAD();
-
-    resultType = compileExpression3(argType1);
-    break;
-  case SB_MINUS:
-    eat(SB_MINUS);
-    checkIntType(argType1);
-    argType2 = compileTerm();
-    checkIntType(argType2);
-
-    genSB();
-
-    resultType = compileExpression3(argType1);
-    break;
-    // check the FOLLOW set
+// Tokens that may follow an expression
+int isExpressionFollow(TokenType tokenType) {
+  switch (tokenType) {
   case KW_TO:
   case KW_DO:
   case SB_RPAR:
@@ -756,89 +665,101 @@ Type* compileExpression3(Type* argType1) {
   case KW_END:
   case KW_ELSE:
   case KW_THEN:
-    resultType = argType1;
-    break;
+    return 1;
   default:
-    error(ERR_INVALID_EXPRESSION, lookAhead->lineNo, lookAhead->colNo);
+    return 0;
   }
-  return resultType;
 }
 
-Type* compileTerm(void) {
-  Type* type;
-  // đề 2020 bài 1: Term sử dụng Power để ưu tiên '**' cao hơn * /
-  type = compilePower();
-  type = compileTerm2(type);
-
-  return type;
-}
-
-Type* compileTerm2(Type* argType1) {
-  Type* argType2;
-  Type* resultType;
-
-  switch (lookAhead->tokenType) {
-  case SB_TIMES:
-    eat(SB_TIMES);
-    checkIntType(argType1);
-    argType2 = compilePower();
-    checkIntType(argType2);
+// Expression2 ::= Term {(+|-) Term}, Term ::= Power {(*|/) Power} and
+// Power ::= Factor [** Power], parsed by one loop per precedence level
+// instead of a call per operator, so the stack depth does not grow with
+// the length of an expression (only with its nesting). Sums and terms
+// grow to the left; a run of '**' is right-associative, so each new
+// factor goes under the innermost '**' built so far.
+// The type of a sum, term or power is that of its first operand.
+Expression* compileExpression2(void) {
+  Expression* exp = NULL;       // the sum so far
+  Expression* term = NULL;      // the term so far
+  Expression* power;            // the power so far
+  Expression* innermost;        // its innermost '**', NULL if none
+  Expression* factor;           // its last factor
+  TokenType addOp = TK_NONE;    // + or - waiting for its right operand
+  TokenType mulOp;              // * or / waiting for its right operand
+
+  for (;;) {
+    mulOp = TK_NONE;
+
+    for (;;) {
+      power = factor = compileFactor();
+      innermost = NULL;
+      // đề 2020 bài 1: '**' ưu tiên cao hơn * / và kết hợp phải
+      while (lookAhead->tokenType == SB_POWER) {
+	eat(SB_POWER);
+	checkIntType(factor->type);
+	factor = compileFactor();
+	if (innermost == NULL)
+	  innermost = power = makeBinaryExpression(SB_POWER, power, factor);
+	else {
+	  innermost->binary.right = makeBinaryExpression(SB_POWER, innermost->binary.right, factor);
+	  innermost = innermost->binary.right;
+	}
+      }
+      if (innermost != NULL)
+	checkIntType(factor->type);
+
+      if (mulOp == TK_NONE)
+	term = power;
+      else {
+	checkIntType(power->type);
+	term = makeBinaryExpression(mulOp, term, power);
+      }
 
-    genML();
+      mulOp = lookAhead->tokenType;
+      if ((mulOp != SB_TIMES) && (mulOp != SB_SLASH))
+	break;
+      eat(mulOp);
+      checkIntType(term->type);
+    }
 
-    resultType = compileTerm2(argType1);
-    break;
-  case SB_SLASH:
-    eat(SB_SLASH);
-    checkIntType(argType1);
-    argType2 = compilePower();
-    checkIntType(argType2);
+    // check the FOLLOW set of Term
+    if ((mulOp != SB_PLUS) && (mulOp != SB_MINUS) && !isExpressionFollow(mulOp))
+      error(ERR_INVALID_TERM, lookAhead->offset);
 
-    genDV();
+    if (addOp == TK_NONE)
+      exp = term;
+    else {
+      checkIntType(term->type);
+      exp = makeBinaryExpression(addOp, exp, term);
+    }
 
-    resultType = compileTerm2(argType1);
-    break;
-    // check the FOLLOW set (bao gồm cả SB_POWER)
-  case SB_PLUS:
-  case SB_MINUS:
-  case SB_POWER:
-  case KW_TO:
-  case KW_DO:
-  case SB_RPAR:
-  case SB_COMMA:
-  case SB_EQ:
-  case SB_NEQ:
-  case SB_LE:
-  case SB_LT:
-  case SB_GE:
-  case SB_GT:
-  case SB_RSEL:
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-  case KW_THEN:
-    resultType = argType1;
-    break;
-  default:
-    error(ERR_INVALID_TERM, lookAhead->lineNo, lookAhead->colNo);
+    addOp = lookAhead->tokenType;
+    if ((addOp != SB_PLUS) && (addOp != SB_MINUS))
+      break;
+    eat(addOp);
+    checkIntType(exp->type);
   }
-  return resultType;
+
+  // check the FOLLOW set of Expression
+  if (!isExpressionFollow(addOp))
+    error(ERR_INVALID_EXPRESSION, lookAhead->offset);
+  return exp;
 }
 
-Type* compileFactor(void) {
-  Type* type;
+Expression* compileFactor(void) {
+  Expression* exp;
+  Expression* indexes;
   Object* obj;
+  Type* type;
 
   switch (lookAhead->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
-    type = intType;
-    genLC(currentToken->value);
+    exp = makeConstantExpression(currentToken->value, intType);
     break;
   case TK_CHAR:
     eat(TK_CHAR);
-    type = charType;
-    genLC(currentToken->value);
+    exp = makeConstantExpression(currentToken->value, charType);
     break;
   case TK_IDENT:
     eat(TK_IDENT);
@@ -846,95 +767,64 @@ Type* compileFactor(void) {
 
     switch (obj->kind) {
     case OBJ_CONSTANT:
-      switch (obj->constAttrs->value->type) {
+      switch (obj->constAttrs.value->type) {
       case TP_INT:
-	type = intType;
-	genLC(obj->constAttrs->value->intValue);
+	exp = makeConstantExpression(obj->constAttrs.value->intValue, intType);
 	break;
       case TP_CHAR:
-	type = charType;
-	genLC(obj->constAttrs->value->charValue);
+	exp = makeConstantExpression(obj->constAttrs.value->charValue, charType);
 	break;
       default:
 	break;
       }
       break;
     case OBJ_VARIABLE:
-      if (obj->varAttrs->type->typeClass == TP_ARRAY) {
-	genVariableAddress(obj);
-	type = compileIndexes(obj->varAttrs->type);
-	genLI();
-      } else {
-	type = obj->varAttrs->type;
-	genVariableValue(obj);
-      }
+      if (obj->varAttrs.type->typeClass == TP_ARRAY) {
+	type = compileIndexes(obj->varAttrs.type, &indexes);
+	exp = makeVariableExpression(makeLValue(obj, indexes, type));
+      } else
+	exp = makeVariableExpression(makeLValue(obj, NULL, obj->varAttrs.type));
       break;
     case OBJ_PARAMETER:
-      type = obj->paramAttrs->type;
-      genParameterValue(obj);
-      if (obj->paramAttrs->kind == PARAM_REFERENCE)
-	genLI();
+      exp = makeVariableExpression(makeLValue(obj, NULL, obj->paramAttrs.type));
       break;
     case OBJ_FUNCTION:
-      if (isPredefinedFunction(obj)) {
-	compileArguments(obj->funcAttrs->paramList);
-	genPredefinedFunctionCall(obj);
-      } else {
-	genINT(4);
-	compileArguments(obj->funcAttrs->paramList);
-	genDCT(4+obj->funcAttrs->paramCount);
-	genFunctionCall(obj);
-      }
-      type = obj->funcAttrs->returnType;
+      exp = makeCallExpression(obj, compileArguments(obj->funcAttrs.paramList));
       break;
     default: 
-      error(ERR_INVALID_FACTOR,currentToken->lineNo, currentToken->colNo);
+      error(ERR_INVALID_FACTOR,currentToken->offset);
       break;
     }
     break;
   case SB_LPAR:
     eat(SB_LPAR);
-    type = compileExpression();
+    exp = compileExpression();
     eat(SB_RPAR);
     break;
   default:
-    error(ERR_INVALID_FACTOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_FACTOR, lookAhead->offset);
   }
   
-  return type;
-}
-
-// đề 2020 bài 1: thêm phân tích toán tử lấy mũ '**' với kết hợp phải
-Type* compilePower(void) {
-  Type* leftType;
-  Type* rightType;
-
-  leftType = compileFactor();
-  // Right-associative: if '**' then parse another Power
-  if (lookAhead->tokenType == SB_POWER) {
-    eat(SB_POWER);
-    checkIntType(leftType);
-    rightType = compilePower();
-    checkIntType(rightType);
-    genPW();
-    return leftType;
-  }
-  return leftType;
+  return exp;
 }
 
-Type* compileIndexes(Type* arrayType) {
-  Type* type;
+// Compiles the subscripts of an array variable into a list linked by
+// next. Returns the type of the element they select.
+Type* compileIndexes(Type* arrayType, Expression** indexes) {
+  Expression* exp;
+  Expression* last = NULL;
 
-  
+  *indexes = NULL;
   while (lookAhead->tokenType == SB_LSEL) {
     eat(SB_LSEL);
-    type = compileExpression();
-    checkIntType(type);
+    exp = compileExpression();
+    checkIntType(exp->type);
     checkArrayType(arrayType);
 
-    genLC(sizeOfType(arrayType->elementType));
-    genML();
-    genAD();
+    if (last == NULL)
+      *indexes = exp;
+    else last->next = exp;
+    last = exp;
 
     arrayType = arrayType->elementType;
     eat(SB_RSEL);
@@ -943,21 +833,71 @@ Type* compileIndexes(Type* arrayType) {
   return arrayType;
 }
 
-int compile(char *fileName) {
-  if (openInputStream(fileName) == IO_ERROR)
-    return IO_ERROR;
+// Compiles the program held by the reader. An error unwinds straight back
+// here; whatever was built so far goes with the arena.
+CompileResult* compileInput(CompileOptions* options) {
+  CompileResult* result = (CompileResult*) malloc(sizeof(CompileResult));
+  jmp_buf errorExit;
+  Block* program;
+  int level = (options != NULL) ? options->optimizeLevel : DEFAULT_OPTIMIZE_LEVEL;
+
+  result->code = NULL;
+  compileArena = createArena();
+  initStringPool();
+  initCodeBuffer();
+  initScanner();
+  startDiagnostics(&errorExit);
+
+  if (setjmp(errorExit) == 0) {
+    if ((options != NULL) && options->scanInThread)
+      startScanThread();
+    currentToken = NULL;
+    lookAhead = getValidToken();
+
+    initSymTab();
+
+    program = compileProgram();
+    optimizeProgram(program, level);
+    genProgram(program);
+    result->code = takeCodeBuffer();
+    optimizeCode(result->code, level);
+  }
 
-  currentToken = NULL;
-  lookAhead = getValidToken();
+  stopScanThread();
+  result->diagnostics = endDiagnostics(&result->diagnosticCount);
+  cleanCodeBuffer();
+  cleanSymTab();
+  cleanStringPool();
+  freeArena(compileArena);
+  compileArena = NULL;
+  return result;
+}
 
-  initSymTab();
+// Compiles length bytes of source. The buffer is only read, and only
+// during the call.
+CompileResult* compileSource(char *source, int length, CompileOptions* options) {
+  CompileResult* result;
 
-  compileProgram();
+  openInputBuffer(source, length);
+  result = compileInput(options);
+  closeInputStream();
+  return result;
+}
 
-  cleanSymTab();
-  free(currentToken);
-  free(lookAhead);
+// Returns NULL if the file cannot be read
+CompileResult* compileFile(char *fileName, CompileOptions* options) {
+  CompileResult* result;
+
+  if (openInputStream(fileName) == IO_ERROR)
+    return NULL;
+  result = compileInput(options);
   closeInputStream();
-  return IO_SUCCESS;
+  return result;
+}
 
+void freeCompileResult(CompileResult* result) {
+  if (result->code != NULL)
+    freeCodeBlock(result->code);
+  free(result->diagnostics);
+  free(result);
 }
@@ -7,12 +7,37 @@
 #define __PARSER_H__
 #include "token.h"
 #include "symtab.h"
+#include "ast.h"
+#include "error.h"
+#include "instructions.h"
+
+// The compiler's entry points. Each call is independent of any other, and
+// calls on separate threads may run at the same time.
+
+struct CompileOptions_ {
+  int scanInThread;             // scan ahead of the parser on a thread of its own
+  int optimizeLevel;            // OPTIMIZE_NONE, OPTIMIZE_BASIC or OPTIMIZE_SSA
+};
+
+typedef struct CompileOptions_ CompileOptions;
+
+struct CompileResult_ {
+  CodeBlock* code;              // NULL if the program has errors
+  Diagnostic* diagnostics;
+  int diagnosticCount;
+};
+
+typedef struct CompileResult_ CompileResult;
+
+CompileResult* compileSource(char *source, int length, CompileOptions* options);
+CompileResult* compileFile(char *fileName, CompileOptions* options);
+void freeCompileResult(CompileResult* result);
 
 void scan(void);
 void eat(TokenType tokenType);
 
-void compileProgram(void);
-void compileBlock(void);
+Block* compileProgram(void);
+void compileBlock(Block* block);
 void compileBlock2(void);
 void compileBlock3(void);
 void compileBlock4(void);
@@ -23,38 +48,32 @@ void compileTypeDecls(void);
 void compileTypeDecl(void);
 void compileVarDecls(void);
 void compileVarDecl(void);
-void compileSubDecls(void);
-void compileFuncDecl(void);
-void compileProcDecl(void);
+void compileSubDecls(Block* block);
+Block* compileFuncDecl(void);
+Block* compileProcDecl(void);
 ConstantValue* compileUnsignedConstant(void);
 ConstantValue* compileConstant(void);
-ConstantValue* compileConstant2(void);
+int compileArraySize(void);
 Type* compileType(void);
 Type* compileBasicType(void);
 void compileParams(void);
 void compileParam(void);
-void compileStatements(void);
-void compileStatement(void);
-Type* compileLValue(void);
-void compileAssignSt(void);
-void compileCallSt(void);
-void compileGroupSt(void);
-void compileIfSt(void);
+Statement* compileStatements(void);
+Statement* compileStatement(void);
+LValue* compileLValue(void);
+Statement* compileAssignSt(void);
+Statement* compileCallSt(void);
+Statement* compileGroupSt(void);
+Statement* compileIfSt(void);
 void compileElseSt(void);
-void compileWhileSt(void);
-void compileForSt(void);
-void compileArgument(Object* param);
-void compileArguments(ObjectNode* paramList);
-void compileCondition(void);
-Type* compileExpression(void);
-Type* compileExpression2(void);
-Type* compileExpression3(Type* argType1);
-Type* compileTerm(void);
-Type* compileTerm2(Type* argType2);
-Type* compilePower(void); // đề 2020 bài 1: thêm cấp độ toán tử lấy mũ
-Type* compileFactor(void);
-Type* compileIndexes(Type* arrayType);
-
-int compile(char *fileName);
+Statement* compileWhileSt(void);
+Statement* compileForSt(void);
+Expression* compileArgument(Object* param);
+Expression* compileArguments(ObjectNode* paramList);
+Expression* compileCondition(void);
+Expression* compileExpression(void);
+Expression* compileExpression2(void);
+Expression* compileFactor(void);
+Type* compileIndexes(Type* arrayType, Expression** indexes);
 
 #endif
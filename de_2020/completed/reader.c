@@ -5,33 +5,177 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+  #define USE_MMAP 0
+#else
+  #define USE_MMAP 1
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+#include "state.h"
 #include "reader.h"
 
-FILE *inputStream;
-int lineNo, colNo;
-int currentChar;
+#define SOURCE_MAPPED 1
+#define SOURCE_ALLOCATED 2
+#define SOURCE_BORROWED 3
+
+COMPILER_STATE char *inputBuffer;
+COMPILER_STATE int inputLength;
+COMPILER_STATE int inputSource;
+COMPILER_STATE int charOffset;
+COMPILER_STATE int currentChar;
+
+COMPILER_STATE int *newlines = NULL;    // offsets of the newlines in the source, built on demand
+COMPILER_STATE int newlineCount;
 
 int readChar(void) {
-  currentChar = getc(inputStream);
-  colNo ++;
-  if (currentChar == '\n') {
-    lineNo ++;
-    colNo = 0;
+  if (charOffset + 1 < inputLength) {
+    charOffset ++;
+    currentChar = (unsigned char) inputBuffer[charOffset];
+  } else {
+    charOffset = inputLength;
+    currentChar = EOF;
   }
   return currentChar;
 }
 
+// Moves currentChar forward to inputBuffer[offset], offset <= inputLength
+void advanceTo(int offset) {
+  charOffset = offset;
+  currentChar = (offset < inputLength) ? (unsigned char) inputBuffer[offset] : EOF;
+}
+
+// Positions are only needed for diagnostics, so the newlines are found
+// the first time one is asked for (memchr searches a vector at a time)
+void indexNewlines(void) {
+  char *p = inputBuffer;
+  char *end = inputBuffer + inputLength;
+  char *nl;
+  int capacity = 64;
+
+  newlines = (int*) malloc(capacity * sizeof(int));
+  newlineCount = 0;
+  while ((p < end) && ((nl = (char*) memchr(p, '\n', end - p)) != NULL)) {
+    if (newlineCount == capacity) {
+      capacity *= 2;
+      newlines = (int*) realloc(newlines, capacity * sizeof(int));
+    }
+    newlines[newlineCount ++] = nl - inputBuffer;
+    p = nl + 1;
+  }
+}
+
+// Converts an offset in the source, offset <= inputLength, to the line and
+// column readChar used to count: lines from 1, columns from 1, and a newline
+// is column 0 of the line it starts
+void locateOffset(int offset, int *lineNo, int *colNo) {
+  int lo = 0, hi, mid;
+
+  if (newlines == NULL)
+    indexNewlines();
+
+  // lo = number of newlines at or before offset
+  hi = newlineCount;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (newlines[mid] <= offset) lo = mid + 1;
+    else hi = mid;
+  }
+
+  *lineNo = lo + 1;
+  *colNo = offset - ((lo > 0) ? newlines[lo - 1] : -1);
+}
+
+void startReading(void) {
+  charOffset = -1;
+  readChar();
+}
+
+// Reads the whole of fileName into a buffer of its own, which the caller
+// frees. Returns NULL if the file cannot be read.
+char* readInputFile(char *fileName, int *length) {
+  FILE* f = fopen(fileName, "rb");
+  char *buffer;
+  long size;
+
+  if (f == NULL)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size < 0) {
+    fclose(f);
+    return NULL;
+  }
+
+  buffer = (char*) malloc(size + 1);
+  *length = fread(buffer, 1, size, f);
+  fclose(f);
+  return buffer;
+}
+
+int loadInputFile(char *fileName) {
+  inputBuffer = readInputFile(fileName, &inputLength);
+  if (inputBuffer == NULL)
+    return IO_ERROR;
+  inputSource = SOURCE_ALLOCATED;
+  return IO_SUCCESS;
+}
+
 int openInputStream(char *fileName) {
-  inputStream = fopen(fileName, "rt");
-  if (inputStream == NULL)
+#if USE_MMAP
+  struct stat st;
+  int fd = open(fileName, O_RDONLY);
+
+  if (fd < 0)
     return IO_ERROR;
-  lineNo = 1;
-  colNo = 0;
-  readChar();
+  if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      close(fd);
+      inputBuffer = (char*) map;
+      inputLength = st.st_size;
+      inputSource = SOURCE_MAPPED;
+      startReading();
+      return IO_SUCCESS;
+    }
+  }
+  close(fd);
+#endif
+  // Empty files, pipes and systems without mmap: read it all into memory
+  if (loadInputFile(fileName) == IO_ERROR)
+    return IO_ERROR;
+  startReading();
   return IO_SUCCESS;
 }
 
-void closeInputStream() {
-  fclose(inputStream);
+int openInputBuffer(char *buffer, int length) {
+  inputBuffer = buffer;
+  inputLength = length;
+  inputSource = SOURCE_BORROWED;
+  startReading();
+  return IO_SUCCESS;
 }
 
+void closeInputStream() {
+  switch (inputSource) {
+#if USE_MMAP
+  case SOURCE_MAPPED:
+    munmap(inputBuffer, inputLength);
+    break;
+#endif
+  case SOURCE_ALLOCATED:
+    free(inputBuffer);
+    break;
+  default:
+    break;
+  }
+  inputBuffer = NULL;
+  inputLength = 0;
+  free(newlines);
+  newlines = NULL;
+}
@@ -10,8 +10,17 @@
 #define IO_ERROR 0
 #define IO_SUCCESS 1
 
+// The whole source is held in one buffer (a read-only mapping of the file
+// when possible); charOffset is the position of currentChar in it.
+// Positions are kept as offsets into the buffer; locateOffset turns one
+// into a line and column.
+
 int readChar(void);
+void advanceTo(int offset);
+void locateOffset(int offset, int *lineNo, int *colNo);
 int openInputStream(char *fileName);
+int openInputBuffer(char *buffer, int length);
 void closeInputStream(void);
+char* readInputFile(char *fileName, int *length);
 
 #endif
@@ -5,247 +5,487 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h>
-#include <ctype.h>
 
+#if !defined(NO_THREADS) && !defined(_WIN32) && defined(__GNUC__) && (__GNUC__ >= 5)
+  #define SCAN_THREAD 1
+  #include <pthread.h>
+  #include <sched.h>
+  #include <unistd.h>
+#else
+  #define SCAN_THREAD 0
+#endif
+
+#include "state.h"
 #include "reader.h"
+#include "arena.h"
 #include "charcode.h"
+#include "charscan.h"
 #include "token.h"
+#include "strpool.h"
 #include "error.h"
 #include "scanner.h"
 
 
-extern int lineNo;
-extern int colNo;
-extern int currentChar;
+extern COMPILER_STATE int currentChar;
+extern COMPILER_STATE int charOffset;
+extern COMPILER_STATE char *inputBuffer;
+extern COMPILER_STATE int inputLength;
+extern COMPILER_STATE Arena *compileArena;
 
 extern CharCode charCodes[];
 
+// The ring of scanned tokens. The scanner thread shares it, so it is
+// allocated from the compilation arena rather than kept per thread.
+struct TokenRing_ {
+  Token tokens[TOKEN_RING_SIZE];
+  unsigned int scanCount;       // tokens scanned into the ring so far
+  unsigned int takeCount;       // tokens handed out by getValidToken so far
+#if SCAN_THREAD
+  pthread_t thread;
+  int threadRunning;
+  int threadDone;               // set by the scanner thread once it has stopped
+  int threadStop;               // set by the parser to make it stop early
+  char *source;                 // the reader as handed to the scanner thread,
+  int sourceLength;             // and charOffset as handed back
+  int charOffset;
+#endif
+};
+
+typedef struct TokenRing_ TokenRing;
+
+COMPILER_STATE TokenRing *ring;
+COMPILER_STATE int tokenStart;  // offset of the first character of the token being scanned
+
+/******************* Scanner automaton ******************************/
+
+// getToken runs a DFA over character classes (charCodes plus a class for
+// end of input). It follows transitions until none applies and then
+// emits the token accepted by the state it stopped in. Adding a symbol
+// means adding a state, its row in stateInfo and its transitions.
+
+#define CLASS_EOF (CHAR_UNKNOWN + 1)
+#define CLASS_COUNT (CHAR_UNKNOWN + 2)
+#define CLASS_ANY CLASS_COUNT   // every class except CLASS_EOF, in transitionSpec only
+
+enum ScanState {
+  S_START, S_BLANK, S_IDENT, S_NUMBER, S_EOF, S_INVALID,
+  S_QUOTE, S_CHAR_BODY, S_CHAR,
+  S_PLUS, S_MINUS, S_TIMES, S_POWER, S_SLASH,
+  S_LT, S_LE, S_GT, S_GE, S_EQ, S_EXCLAIMATION, S_NEQ,
+  S_COMMA, S_PERIOD, S_RSEL, S_SEMICOLON, S_COLON, S_ASSIGN,
+  S_LPAR, S_LSEL, S_RPAR,
+  S_COMMENT, S_COMMENT_STAR, S_COMMENT_END,
+  STATE_COUNT
+};
+
+#define S_DEAD STATE_COUNT
+
+// How a state may be left in bulk instead of character by character
+enum SpanKind { SPAN_NONE, SPAN_BLANK, SPAN_IDENT, SPAN_DIGITS, SPAN_COMMENT };
+
+struct StateInfo {
+  TokenType tokenType;          // token accepted here, TK_NONE if none
+  int skip;                     // nothing to emit: scan again from S_START
+  enum SpanKind span;
+  ErrorCode error;              // reported when stopping in a non-accepting state
+};
+
+// Indexed by ScanState
+struct StateInfo stateInfo[STATE_COUNT] = {
+  {TK_NONE, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_START
+  {TK_NONE, 1, SPAN_BLANK, ERR_INVALID_SYMBOL},           // S_BLANK
+  {TK_IDENT, 0, SPAN_IDENT, ERR_INVALID_SYMBOL},          // S_IDENT
+  {TK_NUMBER, 0, SPAN_DIGITS, ERR_INVALID_SYMBOL},        // S_NUMBER
+  {TK_EOF, 0, SPAN_NONE, ERR_INVALID_SYMBOL},             // S_EOF
+  {TK_NONE, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_INVALID
+  {TK_NONE, 0, SPAN_NONE, ERR_INVALID_CONSTANT_CHAR},     // S_QUOTE
+  {TK_NONE, 0, SPAN_NONE, ERR_INVALID_CONSTANT_CHAR},     // S_CHAR_BODY
+  {TK_CHAR, 0, SPAN_NONE, ERR_INVALID_CONSTANT_CHAR},     // S_CHAR
+  {SB_PLUS, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_PLUS
+  {SB_MINUS, 0, SPAN_NONE, ERR_INVALID_SYMBOL},           // S_MINUS
+  {SB_TIMES, 0, SPAN_NONE, ERR_INVALID_SYMBOL},           // S_TIMES
+  {SB_POWER, 0, SPAN_NONE, ERR_INVALID_SYMBOL},           // S_POWER
+  {SB_SLASH, 0, SPAN_NONE, ERR_INVALID_SYMBOL},           // S_SLASH
+  {SB_LT, 0, SPAN_NONE, ERR_INVALID_SYMBOL},              // S_LT
+  {SB_LE, 0, SPAN_NONE, ERR_INVALID_SYMBOL},              // S_LE
+  {SB_GT, 0, SPAN_NONE, ERR_INVALID_SYMBOL},              // S_GT
+  {SB_GE, 0, SPAN_NONE, ERR_INVALID_SYMBOL},              // S_GE
+  {SB_EQ, 0, SPAN_NONE, ERR_INVALID_SYMBOL},              // S_EQ
+  {TK_NONE, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_EXCLAIMATION
+  {SB_NEQ, 0, SPAN_NONE, ERR_INVALID_SYMBOL},             // S_NEQ
+  {SB_COMMA, 0, SPAN_NONE, ERR_INVALID_SYMBOL},           // S_COMMA
+  {SB_PERIOD, 0, SPAN_NONE, ERR_INVALID_SYMBOL},          // S_PERIOD
+  {SB_RSEL, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_RSEL
+  {SB_SEMICOLON, 0, SPAN_NONE, ERR_INVALID_SYMBOL},       // S_SEMICOLON
+  {SB_COLON, 0, SPAN_NONE, ERR_INVALID_SYMBOL},           // S_COLON
+  {SB_ASSIGN, 0, SPAN_NONE, ERR_INVALID_SYMBOL},          // S_ASSIGN
+  {SB_LPAR, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_LPAR
+  {SB_LSEL, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_LSEL
+  {SB_RPAR, 0, SPAN_NONE, ERR_INVALID_SYMBOL},            // S_RPAR
+  {TK_NONE, 0, SPAN_COMMENT, ERR_END_OF_COMMENT},         // S_COMMENT
+  {TK_NONE, 0, SPAN_NONE, ERR_END_OF_COMMENT},            // S_COMMENT_STAR
+  {TK_NONE, 1, SPAN_NONE, ERR_END_OF_COMMENT}             // S_COMMENT_END
+};
+
+struct Transition {
+  unsigned char from, charClass, to;
+};
+
+// Later entries override earlier ones, so CLASS_ANY rows come first
+struct Transition transitionSpec[] = {
+  {S_QUOTE, CLASS_ANY, S_CHAR_BODY},
+  {S_COMMENT, CLASS_ANY, S_COMMENT},
+  {S_COMMENT_STAR, CLASS_ANY, S_COMMENT},
+
+  {S_START, CHAR_SPACE, S_BLANK},
+  {S_BLANK, CHAR_SPACE, S_BLANK},
+  {S_START, CHAR_LETTER, S_IDENT},
+  {S_IDENT, CHAR_LETTER, S_IDENT},
+  {S_IDENT, CHAR_DIGIT, S_IDENT},
+  {S_START, CHAR_DIGIT, S_NUMBER},
+  {S_NUMBER, CHAR_DIGIT, S_NUMBER},
+  {S_START, CLASS_EOF, S_EOF},
+  {S_START, CHAR_UNKNOWN, S_INVALID},
+
+  {S_START, CHAR_SINGLEQUOTE, S_QUOTE},
+  {S_CHAR_BODY, CHAR_SINGLEQUOTE, S_CHAR},
+
+  {S_START, CHAR_PLUS, S_PLUS},
+  {S_START, CHAR_MINUS, S_MINUS},
+  {S_START, CHAR_TIMES, S_TIMES},
+  {S_TIMES, CHAR_TIMES, S_POWER},
+  {S_START, CHAR_SLASH, S_SLASH},
+  {S_START, CHAR_LT, S_LT},
+  {S_LT, CHAR_EQ, S_LE},
+  {S_START, CHAR_GT, S_GT},
+  {S_GT, CHAR_EQ, S_GE},
+  {S_START, CHAR_EQ, S_EQ},
+  {S_START, CHAR_EXCLAIMATION, S_EXCLAIMATION},
+  {S_EXCLAIMATION, CHAR_EQ, S_NEQ},
+  {S_START, CHAR_COMMA, S_COMMA},
+  {S_START, CHAR_PERIOD, S_PERIOD},
+  {S_PERIOD, CHAR_RPAR, S_RSEL},
+  {S_START, CHAR_SEMICOLON, S_SEMICOLON},
+  {S_START, CHAR_COLON, S_COLON},
+  {S_COLON, CHAR_EQ, S_ASSIGN},
+  {S_START, CHAR_LPAR, S_LPAR},
+  {S_LPAR, CHAR_PERIOD, S_LSEL},
+  {S_START, CHAR_RPAR, S_RPAR},
+
+  {S_LPAR, CHAR_TIMES, S_COMMENT},
+  {S_COMMENT, CHAR_TIMES, S_COMMENT_STAR},
+  {S_COMMENT_STAR, CHAR_TIMES, S_COMMENT_STAR},
+  {S_COMMENT_STAR, CHAR_RPAR, S_COMMENT_END}
+};
+
+unsigned char scanTable[STATE_COUNT][CLASS_COUNT];
+
+void buildScanTable(void) {
+  int count = sizeof(transitionSpec) / sizeof(transitionSpec[0]);
+  int i, c;
+
+  for (i = 0; i < STATE_COUNT; i ++)
+    for (c = 0; c < CLASS_COUNT; c ++)
+      scanTable[i][c] = S_DEAD;
+
+  for (i = 0; i < count; i ++) {
+    if (transitionSpec[i].charClass == CLASS_ANY) {
+      for (c = 0; c < CLASS_EOF; c ++)
+	scanTable[transitionSpec[i].from][c] = transitionSpec[i].to;
+    } else scanTable[transitionSpec[i].from][transitionSpec[i].charClass] = transitionSpec[i].to;
+  }
+}
+
 /***************************************************************/
 
-void skipBlank() {
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_SPACE))
-    readChar();
+Token* makeToken(TokenType tokenType) {
+  Token *token = ring->tokens + (ring->scanCount & (TOKEN_RING_SIZE - 1));
+  token->tokenType = tokenType;
+  token->string = NULL;
+  token->offset = tokenStart;
+  return token;
 }
 
-void skipComment() {
-  int state = 0;
-  while ((currentChar != EOF) && (state < 2)) {
-    switch (charCodes[currentChar]) {
-    case CHAR_TIMES:
-      state = 1;
-      break;
-    case CHAR_RPAR:
-      if (state == 1) state = 2;
-      else state = 0;
-      break;
-    default:
-      state = 0;
+// Jumps over the rest of a run the automaton would otherwise walk one
+// character at a time; returns the state to continue from
+int spanState(int state) {
+  int end;
+
+  switch (stateInfo[state].span) {
+  case SPAN_BLANK:
+    advanceTo(spanBlank(inputBuffer, charOffset, inputLength));
+    break;
+  case SPAN_IDENT:
+    advanceTo(spanIdent(inputBuffer, charOffset, inputLength));
+    break;
+  case SPAN_DIGITS:
+    advanceTo(spanDigits(inputBuffer, charOffset, inputLength));
+    break;
+  case SPAN_COMMENT:
+    end = findCommentEnd(inputBuffer, charOffset, inputLength);
+    if (end < 0) {
+      advanceTo(inputLength);
+      return state;
     }
-    readChar();
+    advanceTo(end);
+    return S_COMMENT_END;
+  default:
+    break;
   }
-  if (state != 2) 
-    error(ERR_END_OF_COMMENT, lineNo, colNo);
+  return state;
 }
 
-Token* readIdentKeyword(void) {
-  Token *token = makeToken(TK_NONE, lineNo, colNo);
-  int count = 1;
-
-  token->string[0] = toupper((char)currentChar);
-  readChar();
-
-  while ((currentChar != EOF) && 
-	 ((charCodes[currentChar] == CHAR_LETTER) || (charCodes[currentChar] == CHAR_DIGIT))) {
-    if (count <= MAX_IDENT_LEN) token->string[count++] = toupper((char)currentChar);
-    readChar();
-  }
+void finishIdentKeyword(Token *token) {
+  int count = token->length;
 
   if (count > MAX_IDENT_LEN) {
-    error(ERR_IDENT_TOO_LONG, token->lineNo, token->colNo);
-    return token;
+    token->tokenType = TK_NONE;
+    token->value = ERR_IDENT_TOO_LONG;
+    return;
   }
 
-  token->string[count] = '\0';
-  token->tokenType = checkKeyword(token->string);
-
+  token->tokenType = checkKeyword(inputBuffer + token->offset, count);
   if (token->tokenType == TK_NONE)
     token->tokenType = TK_IDENT;
+}
 
-  return token;
+void finishNumber(Token *token) {
+  int i;
+
+  token->value = 0;
+  for (i = token->offset; i < token->offset + token->length; i ++)
+    token->value = token->value * 10 + (inputBuffer[i] - '0');
 }
 
-Token* readNumber(void) {
-  Token *token = makeToken(TK_NUMBER, lineNo, colNo);
-  int count = 0;
+void finishConstChar(Token *token) {
+  token->value = (unsigned char) inputBuffer[token->offset + 1];
+}
 
-  while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_DIGIT)) {
-    token->string[count++] = (char)currentChar;
-    readChar();
-  }
+// getToken touches nothing but the reader and the ring slot it fills, so
+// it may run on a thread of its own. A lexical error comes back as a
+// TK_NONE token carrying the error code in value, and strings are
+// interned by whoever takes the token (see acceptToken).
+Token* getToken(void) {
+  Token *token;
+  int state, next;
+
+  do {
+    tokenStart = charOffset;
+    state = S_START;
+
+    for (;;) {
+      next = scanTable[state][(currentChar == EOF) ? CLASS_EOF : charCodes[currentChar]];
+      if (next == S_DEAD) break;
+      if (currentChar == EOF) {
+	state = next;
+	break;
+      }
+      readChar();
+      state = (next == state) ? next : spanState(next);
+    }
+  } while (stateInfo[state].skip);
 
-  token->string[count] = '\0';
-  token->value = atoi(token->string);
+  token = makeToken(stateInfo[state].tokenType);
+  token->length = charOffset - tokenStart;
+
+  switch (token->tokenType) {
+  case TK_NONE:
+    token->value = stateInfo[state].error;
+    break;
+  case TK_IDENT:
+    finishIdentKeyword(token);
+    break;
+  case TK_NUMBER:
+    finishNumber(token);
+    break;
+  case TK_CHAR:
+    finishConstChar(token);
+    break;
+  default:
+    break;
+  }
   return token;
 }
 
-Token* readConstChar(void) {
-  Token *token = makeToken(TK_CHAR, lineNo, colNo);
+// The automaton and the bulk scanners are shared by all compilations and
+// built only once
+void initScanTables(void) {
+  initCharScan();
+  buildScanTable();
+}
 
-  readChar();
-  if (currentChar == EOF) {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
+#if SCAN_THREAD
+pthread_once_t scanTablesOnce = PTHREAD_ONCE_INIT;
+#else
+int scanTablesBuilt = 0;
+#endif
+
+void initScanner(void) {
+#if SCAN_THREAD
+  pthread_once(&scanTablesOnce, initScanTables);
+#else
+  if (!scanTablesBuilt) {
+    initScanTables();
+    scanTablesBuilt = 1;
   }
-    
-  token->string[0] = currentChar;
-  token->string[1] = '\0';
-  token->value = currentChar;
+#endif
+  ring = (TokenRing*) arenaAlloc(compileArena, sizeof(TokenRing));
+  ring->scanCount = 0;
+  ring->takeCount = 0;
+#if SCAN_THREAD
+  ring->threadRunning = 0;
+#endif
+}
 
-  readChar();
-  if (currentChar == EOF) {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
-  }
+void scanValidToken(void) {
+  getToken();
+  ring->scanCount ++;
+}
 
-  if (charCodes[currentChar] == CHAR_SINGLEQUOTE) {
-    readChar();
-    return token;
-  } else {
-    token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
-    return token;
+// Interns the token's text in the string pool. The pool and the arena
+// behind it belong to the parser's thread, so this is done on that side.
+void internToken(Token *token) {
+  if (token->string != NULL) return;
+
+  switch (token->tokenType) {
+  case TK_IDENT:
+    token->string = internIdentifier(inputBuffer + token->offset, token->length);
+    break;
+  case TK_NUMBER:
+    token->string = internLexeme(inputBuffer + token->offset, token->length);
+    break;
+  case TK_CHAR:
+    token->string = internLexeme(inputBuffer + token->offset + 1, 1);
+    break;
+  default:
+    break;
   }
 }
 
-Token* getToken(void) {
+Token* acceptToken(Token *token) {
+  // An unclosed comment is reported where the input ends
+  if (token->tokenType == TK_NONE)
+    error((ErrorCode) token->value,
+	  (token->value == ERR_END_OF_COMMENT) ? token->offset + token->length : token->offset);
+  internToken(token);
+  return token;
+}
+
+#if SCAN_THREAD
+
+/******************* Scanner thread ******************************/
+
+// With the scanner on its own thread the ring becomes a single-producer
+// single-consumer queue: the scanner thread is the only writer of
+// scanCount and the parser the only writer of takeCount. The scanner
+// publishes a token by bumping scanCount and may fill a slot only while
+// the parser holds fewer than MAX_LOOKAHEAD unread tokens, which keeps
+// currentToken and lookAhead from being overwritten.
+
+#define LOAD_COUNT(c) __atomic_load_n(&(c), __ATOMIC_ACQUIRE)
+#define STORE_COUNT(c, v) __atomic_store_n(&(c), (v), __ATOMIC_RELEASE)
+
+void* scanThreadMain(void *arg) {
   Token *token;
-  int ln, cn;
-
-  if (currentChar == EOF) 
-    return makeToken(TK_EOF, lineNo, colNo);
-
-  switch (charCodes[currentChar]) {
-  case CHAR_SPACE: skipBlank(); return getToken();
-  case CHAR_LETTER: return readIdentKeyword();
-  case CHAR_DIGIT: return readNumber();
-  case CHAR_PLUS: 
-    token = makeToken(SB_PLUS, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_MINUS:
-    token = makeToken(SB_MINUS, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_TIMES:
-    // đề 2020 bài 1: kiểm tra nếu là ** (phép lấy mũ)
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_TIMES)) {
-      readChar();
-      return makeToken(SB_POWER, ln, cn);
-    } else return makeToken(SB_TIMES, ln, cn);
-  case CHAR_SLASH:
-    token = makeToken(SB_SLASH, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_LT:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_LE, ln, cn);
-    } else return makeToken(SB_LT, ln, cn);
-  case CHAR_GT:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_GE, ln, cn);
-    } else return makeToken(SB_GT, ln, cn);
-  case CHAR_EQ: 
-    token = makeToken(SB_EQ, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_EXCLAIMATION:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_NEQ, ln, cn);
-    } else {
-      token = makeToken(TK_NONE, ln, cn);
-      error(ERR_INVALID_SYMBOL, ln, cn);
-      return token;
+
+  // The reader is per thread: pick it up where the parser's thread left it
+  ring = (TokenRing*) arg;
+  inputBuffer = ring->source;
+  inputLength = ring->sourceLength;
+  advanceTo(ring->charOffset);
+
+  do {
+    while (ring->scanCount - LOAD_COUNT(ring->takeCount) >= MAX_LOOKAHEAD) {
+      if (LOAD_COUNT(ring->threadStop)) goto done;
+      sched_yield();
     }
-  case CHAR_COMMA:
-    token = makeToken(SB_COMMA, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_PERIOD:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_RPAR)) {
-      readChar();
-      return makeToken(SB_RSEL, ln, cn);
-    } else return makeToken(SB_PERIOD, ln, cn);
-  case CHAR_SEMICOLON:
-    token = makeToken(SB_SEMICOLON, lineNo, colNo);
-    readChar(); 
-    return token;
-  case CHAR_COLON:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
-      readChar();
-      return makeToken(SB_ASSIGN, ln, cn);
-    } else return makeToken(SB_COLON, ln, cn);
-  case CHAR_SINGLEQUOTE: return readConstChar();
-  case CHAR_LPAR:
-    ln = lineNo;
-    cn = colNo;
-    readChar();
-
-    if (currentChar == EOF) 
-      return makeToken(SB_LPAR, ln, cn);
-
-    switch (charCodes[currentChar]) {
-    case CHAR_PERIOD:
-      readChar();
-      return makeToken(SB_LSEL, ln, cn);
-    case CHAR_TIMES:
-      readChar();
-      skipComment();
-      return getToken();
-    default:
-      return makeToken(SB_LPAR, ln, cn);
+    token = getToken();
+    STORE_COUNT(ring->scanCount, ring->scanCount + 1);
+  } while ((token->tokenType != TK_EOF) && (token->tokenType != TK_NONE));
+
+ done:
+  ring->charOffset = charOffset;
+  STORE_COUNT(ring->threadDone, 1);
+  return arg;
+}
+
+// Starts scanning ahead on a thread of its own. Keeps scanning on demand
+// on a single processor, where the two threads would only take turns,
+// or if the thread cannot be created.
+void startScanThread(void) {
+  ring->threadDone = 0;
+  ring->threadStop = 0;
+  ring->source = inputBuffer;
+  ring->sourceLength = inputLength;
+  ring->charOffset = charOffset;
+  if (sysconf(_SC_NPROCESSORS_ONLN) < 2) return;
+  ring->threadRunning = (pthread_create(&ring->thread, NULL, scanThreadMain, ring) == 0);
+}
+
+// Stops the scanner thread, if any, and takes the reader back
+void stopScanThread(void) {
+  if (!ring->threadRunning) return;
+  STORE_COUNT(ring->threadStop, 1);
+  pthread_join(ring->thread, NULL);
+  ring->threadRunning = 0;
+  advanceTo(ring->charOffset);
+}
+
+// Waits until at least k tokens are queued. Once the scanner thread has
+// finished (after EOF or an error) any further tokens are scanned here.
+void waitTokens(unsigned int k) {
+  while (LOAD_COUNT(ring->scanCount) - ring->takeCount < k) {
+    if (LOAD_COUNT(ring->threadDone)) {
+      stopScanThread();
+      while (ring->scanCount - ring->takeCount < k)
+        scanValidToken();
+      return;
     }
-  case CHAR_RPAR:
-    token = makeToken(SB_RPAR, lineNo, colNo);
-    readChar(); 
-    return token;
-  default:
-    token = makeToken(TK_NONE, lineNo, colNo);
-    error(ERR_INVALID_SYMBOL, lineNo, colNo);
-    readChar(); 
-    return token;
+    sched_yield();
   }
 }
 
+#else
+
+void startScanThread(void) {
+}
+
+void stopScanThread(void) {
+}
+
+#endif
+
 Token* getValidToken(void) {
-  Token *token = getToken();
-  while (token->tokenType == TK_NONE) {
-    free(token);
-    token = getToken();
+  Token *token;
+
+#if SCAN_THREAD
+  if (ring->threadRunning) {
+    waitTokens(1);
+    token = acceptToken(ring->tokens + (ring->takeCount & (TOKEN_RING_SIZE - 1)));
+    STORE_COUNT(ring->takeCount, ring->takeCount + 1);
+    return token;
   }
+#endif
+  if (ring->takeCount == ring->scanCount)
+    scanValidToken();
+  token = ring->tokens + (ring->takeCount++ & (TOKEN_RING_SIZE - 1));
+  return acceptToken(token);
+}
+
+// Returns the k-th token after the last one handed out, 1 <= k <= MAX_LOOKAHEAD.
+// Lexical errors in a peeked token are reported only once it is taken.
+Token* peekToken(int k) {
+  Token *token;
+
+#if SCAN_THREAD
+  if (ring->threadRunning)
+    waitTokens((unsigned int) k);
+  else
+#endif
+  while (ring->scanCount - ring->takeCount < (unsigned int) k)
+    scanValidToken();
+  token = ring->tokens + ((ring->takeCount + k - 1) & (TOKEN_RING_SIZE - 1));
+  internToken(token);
   return token;
 }
 
@@ -253,8 +493,10 @@ Token* getValidToken(void) {
 /******************************************************************/
 
 void printToken(Token *token) {
+  int lineNo, colNo;
 
-  printf("%d-%d:", token->lineNo, token->colNo);
+  locateOffset(token->offset, &lineNo, &colNo);
+  printf("%d-%d:", lineNo, colNo);
 
   switch (token->tokenType) {
   case TK_NONE: printf("TK_NONE\n"); break;
@@ -9,8 +9,20 @@
 
 #include "token.h"
 
+// Tokens live in a ring owned by the scanner. A token handed out by
+// getValidToken stays valid until TOKEN_RING_SIZE - MAX_LOOKAHEAD further
+// tokens have been handed out, which covers currentToken and lookAhead.
+// When scanning on a thread of its own the ring is also the queue between
+// the scanner and the parser, hence its size.
+#define TOKEN_RING_SIZE 256
+#define MAX_LOOKAHEAD (TOKEN_RING_SIZE - 2)
+
+void initScanner(void);
+void startScanThread(void);
+void stopScanThread(void);
 Token* getToken(void);
 Token* getValidToken(void);
+Token* peekToken(int k);
 void printToken(Token *token);
 
 #endif
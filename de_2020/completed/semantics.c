@@ -6,12 +6,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "state.h"
 #include "debug.h"
 #include "semantics.h"
 #include "error.h"
 
-extern SymTab* symtab;
-extern Token* currentToken;
+extern COMPILER_STATE SymTab* symtab;
+extern COMPILER_STATE Token* currentToken;
 
 Object* lookupObject(char *name) {
   Scope* scope = symtab->currentScope;
@@ -29,13 +30,13 @@ Object* lookupObject(char *name) {
 
 void checkFreshIdent(char *name) {
   if (findObject(symtab->currentScope->objList, name) != NULL)
-    error(ERR_DUPLICATE_IDENT, currentToken->lineNo, currentToken->colNo);
+    error(ERR_DUPLICATE_IDENT, currentToken->offset);
 }
 
 Object* checkDeclaredIdent(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL) {
-    error(ERR_UNDECLARED_IDENT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_IDENT,currentToken->offset);
   }
   return obj;
 }
@@ -43,9 +44,9 @@ Object* checkDeclaredIdent(char* name) {
 Object* checkDeclaredConstant(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_CONSTANT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_CONSTANT,currentToken->offset);
   if (obj->kind != OBJ_CONSTANT)
-    error(ERR_INVALID_CONSTANT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_CONSTANT,currentToken->offset);
 
   return obj;
 }
@@ -53,9 +54,9 @@ Object* checkDeclaredConstant(char* name) {
 Object* checkDeclaredType(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_TYPE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_TYPE,currentToken->offset);
   if (obj->kind != OBJ_TYPE)
-    error(ERR_INVALID_TYPE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_TYPE,currentToken->offset);
 
   return obj;
 }
@@ -63,9 +64,9 @@ Object* checkDeclaredType(char* name) {
 Object* checkDeclaredVariable(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_VARIABLE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_VARIABLE,currentToken->offset);
   if (obj->kind != OBJ_VARIABLE)
-    error(ERR_INVALID_VARIABLE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_VARIABLE,currentToken->offset);
 
   return obj;
 }
@@ -73,9 +74,9 @@ Object* checkDeclaredVariable(char* name) {
 Object* checkDeclaredFunction(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_FUNCTION,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_FUNCTION,currentToken->offset);
   if (obj->kind != OBJ_FUNCTION)
-    error(ERR_INVALID_FUNCTION,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_FUNCTION,currentToken->offset);
 
   return obj;
 }
@@ -83,9 +84,9 @@ Object* checkDeclaredFunction(char* name) {
 Object* checkDeclaredProcedure(char* name) {
   Object* obj = lookupObject(name);
   if (obj == NULL) 
-    error(ERR_UNDECLARED_PROCEDURE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_PROCEDURE,currentToken->offset);
   if (obj->kind != OBJ_PROCEDURE)
-    error(ERR_INVALID_PROCEDURE,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_PROCEDURE,currentToken->offset);
 
   return obj;
 }
@@ -95,7 +96,7 @@ Object* checkDeclaredLValueIdent(char* name) {
   Scope* scope;
 
   if (obj == NULL)
-    error(ERR_UNDECLARED_IDENT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_IDENT,currentToken->offset);
 
   switch (obj->kind) {
   case OBJ_VARIABLE:
@@ -103,14 +104,14 @@ Object* checkDeclaredLValueIdent(char* name) {
     break;
   case OBJ_FUNCTION:
     scope = symtab->currentScope;
-    while ((scope != NULL) && (scope != obj->funcAttrs->scope)) 
+    while ((scope != NULL) && (scope != obj->funcAttrs.scope)) 
       scope = scope->outer;
 
     if (scope == NULL)
-      error(ERR_INVALID_IDENT,currentToken->lineNo, currentToken->colNo);
+      error(ERR_INVALID_IDENT,currentToken->offset);
     break;
   default:
-    error(ERR_INVALID_IDENT,currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_IDENT,currentToken->offset);
   }
 
   return obj;
@@ -120,30 +121,30 @@ Object* checkDeclaredLValueIdent(char* name) {
 void checkIntType(Type* type) {
   if ((type != NULL) && (type->typeClass == TP_INT))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 void checkCharType(Type* type) {
   if ((type != NULL) && (type->typeClass == TP_CHAR))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 void checkBasicType(Type* type) {
   if ((type != NULL) && ((type->typeClass == TP_INT) || (type->typeClass == TP_CHAR)))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 void checkArrayType(Type* type) {
   if ((type != NULL) && (type->typeClass == TP_ARRAY))
     return;
-  else error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+  else error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 void checkTypeEquality(Type* type1, Type* type2) {
   if (compareType(type1, type2) == 0)
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 
@@ -0,0 +1,2281 @@
+/* SSA optimizer */
+
+#include <stdlib.h>
+#include <string.h>
+#include "state.h"
+#include "arena.h"
+#include "optimize.h"
+#include "codegen.h"
+#include "ssa.h"
+
+extern COMPILER_STATE Arena* compileArena;
+extern COMPILER_STATE Type* intType;
+
+// Each block is optimized on its own. A frame slot of the block gets SSA
+// values if it holds a scalar that only the block itself can reach: no
+// nested subprogram uses it and it is never passed by reference. Calls
+// then cannot change it, and every read of it in the tree has exactly one
+// reaching value: one per assignment, one on entry, and a phi where
+// control flow joins. The tree is structured, so the phis are placed as
+// it is walked: after an IF and at the head of a loop.
+//
+// The rounds that follow rewrite the tree in place before it is lowered
+// as usual:
+//  - sparse conditional constant propagation replaces constant
+//    expressions by their values and drops the branches that never run;
+//  - what a loop computes the same way each time round is computed once
+//    before it, into a temporary;
+//  - with value numbers, a read of a copy becomes a read of the original,
+//    and an expression (or the address of an array element) computed
+//    again is taken from a temporary kept by its first occurrence;
+//  - assignments whose values are never read are removed.
+
+#define SCCP_BUDGET 1000000     // statements evaluated before a block is left alone
+#define CSE_MINIMUM_COST 5      // keeping a value costs LA, ST and a load per use
+#define LICM_MINIMUM_COST 2     // a hoisted value is still loaded once per use
+
+/******************* Maps ******************************/
+
+struct MapEntry_ {
+  void* key;
+  void* value;
+};
+
+typedef struct MapEntry_ MapEntry;
+
+// Open addressing on the pointer; the capacity is a power of two
+struct PointerMap_ {
+  MapEntry* entries;
+  int capacity;
+  int count;
+};
+
+typedef struct PointerMap_ PointerMap;
+
+void initMap(PointerMap* map) {
+  map->capacity = 256;
+  map->count = 0;
+  map->entries = (MapEntry*) calloc(map->capacity, sizeof(MapEntry));
+}
+
+void freeMap(PointerMap* map) {
+  free(map->entries);
+  map->entries = NULL;
+}
+
+unsigned int hashPointer(void* key) {
+  unsigned long long k = (unsigned long long) (size_t) key;
+  return (unsigned int) ((k * 11400714819323198485ULL) >> 32);
+}
+
+void* mapGet(PointerMap* map, void* key) {
+  unsigned int i = hashPointer(key) & (map->capacity - 1);
+
+  while (map->entries[i].key != NULL) {
+    if (map->entries[i].key == key)
+      return map->entries[i].value;
+    i = (i + 1) & (map->capacity - 1);
+  }
+  return NULL;
+}
+
+void mapPut(PointerMap* map, void* key, void* value) {
+  MapEntry* old;
+  int oldCapacity, j;
+  unsigned int i;
+
+  if (2 * (map->count + 1) > map->capacity) {
+    old = map->entries;
+    oldCapacity = map->capacity;
+    map->capacity *= 2;
+    map->count = 0;
+    map->entries = (MapEntry*) calloc(map->capacity, sizeof(MapEntry));
+    for (j = 0; j < oldCapacity; j ++)
+      if (old[j].key != NULL)
+	mapPut(map, old[j].key, old[j].value);
+    free(old);
+  }
+
+  i = hashPointer(key) & (map->capacity - 1);
+  while (map->entries[i].key != NULL) {
+    if (map->entries[i].key == key) {
+      map->entries[i].value = value;
+      return;
+    }
+    i = (i + 1) & (map->capacity - 1);
+  }
+  map->entries[i].key = key;
+  map->entries[i].value = value;
+  map->count ++;
+}
+
+/******************* SSA form ******************************/
+
+enum ValueKind {
+  VAL_ENTRY,      // the slot's value when the block is entered
+  VAL_DEF,        // assigned by a statement, or the start of a FOR
+  VAL_JOIN,       // phi after an IF: the values from THEN and from ELSE
+  VAL_LOOP,       // phi at a loop head: the values from entry and from the body
+  VAL_STEP        // a FOR variable stepped at the end of the body
+};
+
+enum LatticeState {
+  LAT_TOP,        // no value reaches it yet
+  LAT_CONST,
+  LAT_BOTTOM      // not a constant
+};
+
+struct Lattice_ {
+  enum LatticeState state;
+  WORD constant;
+};
+
+typedef struct Lattice_ Lattice;
+
+struct Use_;
+
+struct Value_ {
+  enum ValueKind kind;
+  int slot;
+  Expression* exp;              // VAL_DEF: the value assigned
+  Statement* st;                // VAL_DEF: the assignment, NULL for a FOR start
+  struct Value_ *operands[2];   // phis and VAL_STEP
+  struct Value_ *root;          // the value it is a copy of, once known
+  Lattice lattice;
+  int number;                   // value number
+  int removable;                // VAL_DEF: the assignment may go if the value is dead
+  int live;
+  struct Use_ *owned;           // the reads in a removable assignment's value
+};
+
+typedef struct Value_ Value;
+
+struct Use_ {
+  Value* value;
+  struct Use_ *next;
+};
+
+typedef struct Use_ Use;
+
+// What the SSA form knows of an IF, WHILE or FOR statement
+struct Region_ {
+  Value** phis;
+  int phiCount;
+  int executable[2];            // IF: THEN and ELSE; loops: the body
+  Value* start;                 // FOR over a slot: the first value,
+  Value* head;                  //   the phi the loop tests
+  Value* step;                  //   and the value stepped
+};
+
+typedef struct Region_ Region;
+
+// A value computed earlier on every path to the expression being walked
+struct Available_ {
+  Expression* exp;              // its first occurrence,
+  LValue* lvalue;               //   or the first lvalue at this address
+  Object* temp;                 // where the first occurrence keeps it
+};
+
+typedef struct Available_ Available;
+
+struct NumberEntry_ {
+  int tag;                      // an operator token, or one of NUMBER_*
+  int left;
+  int right;
+  int number;                   // 0 if the entry is free
+};
+
+typedef struct NumberEntry_ NumberEntry;
+
+#define NUMBER_CONSTANT (-1)
+#define NUMBER_NEGATE (-2)
+#define NUMBER_ARRAY (-3)
+#define NUMBER_ELEMENT (-4)
+
+struct SSA_ {
+  Scope* scope;
+  int slotCount;
+  Object** slots;               // the object held in each slot
+  int* slotOfOffset;            // frame offset -> slot, -1 if none
+  int offsetCount;
+
+  PointerMap map;               // read -> Value, assignment -> Value, IF/WHILE/FOR -> Region
+  Value** entries;
+  int replaying;                // walk the form again instead of building it
+  Value* owner;                 // the removable assignment being walked
+  Use* essential;               // reads that are never removed
+
+  int* marks;                   // slots collected as assigned in a loop body
+  int* assigned;
+  int assignedCount;
+  int generation;
+
+  NumberEntry* numbers;
+  int numberCapacity;
+  int numberCount;
+  int lastNumber;
+  PointerMap objectNumbers;
+
+  long budget;
+  int failed;
+
+  Available** available;        // value number -> Available
+  int availableCapacity;
+  int* undo;                    // the numbers made available, in order
+  int undoCount;
+  int undoCapacity;
+};
+
+typedef struct SSA_ SSA;
+
+void walkExpression(SSA* ssa, Expression* exp, Value** defs);
+void walkStatement(SSA* ssa, Statement* st, Value** defs);
+
+/******************* Slots ******************************/
+
+int slotOf(SSA* ssa, Object* obj) {
+  int offset;
+
+  if (obj == NULL)
+    return -1;
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+    if (obj->varAttrs.scope != ssa->scope) return -1;
+    offset = obj->varAttrs.localOffset;
+    break;
+  case OBJ_PARAMETER:
+    if (obj->paramAttrs.scope != ssa->scope) return -1;
+    offset = obj->paramAttrs.localOffset;
+    break;
+  default:
+    return -1;
+  }
+  if (offset >= ssa->offsetCount)
+    return -1;                  // a temporary made by the optimizer
+  return ssa->slotOfOffset[offset];
+}
+
+// The object no longer gets a slot
+void dropSlot(SSA* ssa, Object* obj) {
+  int slot = slotOf(ssa, obj);
+
+  if (slot < 0) return;
+  if (obj->kind == OBJ_VARIABLE)
+    ssa->slotOfOffset[obj->varAttrs.localOffset] = -1;
+  else ssa->slotOfOffset[obj->paramAttrs.localOffset] = -1;
+}
+
+void escapeExpression(SSA* ssa, Expression* exp, int nested);
+void escapeStatement(SSA* ssa, Statement* st, int nested);
+
+void escapeLValue(SSA* ssa, LValue* lvalue, int nested) {
+  Expression* index;
+
+  if (lvalue->object == NULL) {
+    escapeExpression(ssa, lvalue->address, nested);
+    return;
+  }
+  if (nested)
+    dropSlot(ssa, lvalue->object);
+  for (index = lvalue->indexes; index != NULL; index = index->next)
+    escapeExpression(ssa, index, nested);
+}
+
+// Drops the slots an expression passes by reference and, in a nested
+// subprogram, every slot it uses
+void escapeExpression(SSA* ssa, Expression* exp, int nested) {
+  Expression* arg;
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+    escapeLValue(ssa, exp->lvalue, nested);
+    break;
+  case EXP_REFERENCE:
+    if (exp->lvalue->object != NULL)
+      dropSlot(ssa, exp->lvalue->object);
+    escapeLValue(ssa, exp->lvalue, nested);
+    break;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      escapeExpression(ssa, arg, nested);
+    break;
+  case EXP_NEGATE:
+    escapeExpression(ssa, exp->operand, nested);
+    break;
+  case EXP_BINARY:
+    for (; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      escapeExpression(ssa, exp->binary.right, nested);
+    escapeExpression(ssa, exp, nested);
+    break;
+  case EXP_SAVE:
+    escapeExpression(ssa, exp->save.operand, nested);
+    break;
+  case EXP_INLINE:
+    escapeStatement(ssa, exp->inlined.body, nested);
+    escapeExpression(ssa, exp->inlined.value, nested);
+    break;
+  default:
+    break;
+  }
+}
+
+void escapeStatement(SSA* ssa, Statement* st, int nested) {
+  Expression* arg;
+  Statement* s;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    escapeLValue(ssa, st->assign.lvalue, nested);
+    escapeExpression(ssa, st->assign.value, nested);
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      escapeExpression(ssa, arg, nested);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      escapeStatement(ssa, s, nested);
+    break;
+  case ST_IF:
+    escapeExpression(ssa, st->ifSt.condition, nested);
+    escapeStatement(ssa, st->ifSt.thenPart, nested);
+    escapeStatement(ssa, st->ifSt.elsePart, nested);
+    break;
+  case ST_WHILE:
+    escapeExpression(ssa, st->whileSt.condition, nested);
+    escapeStatement(ssa, st->whileSt.body, nested);
+    break;
+  case ST_FOR:
+    escapeLValue(ssa, st->forSt.variable, nested);
+    escapeExpression(ssa, st->forSt.from, nested);
+    escapeExpression(ssa, st->forSt.to, nested);
+    escapeStatement(ssa, st->forSt.body, nested);
+    break;
+  }
+}
+
+void escapeBlock(SSA* ssa, Block* block) {
+  Statement* s;
+  Block* subBlock;
+
+  for (s = block->body; s != NULL; s = s->next)
+    escapeStatement(ssa, s, 1);
+  for (subBlock = block->subBlocks; subBlock != NULL; subBlock = subBlock->next)
+    escapeBlock(ssa, subBlock);
+}
+
+void findSlots(SSA* ssa, Block* block) {
+  ObjectNode* node;
+  Object* obj;
+  Statement* s;
+  Block* subBlock;
+  int offset;
+
+  ssa->scope = block->scope;
+  ssa->offsetCount = block->scope->frameSize;
+  ssa->slotOfOffset = (int*) malloc(ssa->offsetCount * sizeof(int));
+  ssa->slots = (Object**) malloc(ssa->offsetCount * sizeof(Object*));
+  for (offset = 0; offset < ssa->offsetCount; offset ++)
+    ssa->slotOfOffset[offset] = -1;
+
+  for (node = block->scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if ((obj->kind == OBJ_VARIABLE) && (obj->varAttrs.type->typeClass != TP_ARRAY))
+      ssa->slotOfOffset[obj->varAttrs.localOffset] = 0;
+    else if ((obj->kind == OBJ_PARAMETER) && (obj->paramAttrs.kind == PARAM_VALUE))
+      ssa->slotOfOffset[obj->paramAttrs.localOffset] = 0;
+  }
+
+  for (s = block->body; s != NULL; s = s->next)
+    escapeStatement(ssa, s, 0);
+  for (subBlock = block->subBlocks; subBlock != NULL; subBlock = subBlock->next)
+    escapeBlock(ssa, subBlock);
+
+  ssa->slotCount = 0;
+  for (node = block->scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if (slotOf(ssa, obj) == 0) {
+      offset = (obj->kind == OBJ_VARIABLE) ? obj->varAttrs.localOffset : obj->paramAttrs.localOffset;
+      ssa->slots[ssa->slotCount] = obj;
+      ssa->slotOfOffset[offset] = ssa->slotCount ++;
+    }
+  }
+}
+
+/******************* Value numbers ******************************/
+
+void resetNumbers(SSA* ssa) {
+  free(ssa->numbers);
+  ssa->numberCapacity = 256;
+  ssa->numberCount = 0;
+  ssa->numbers = (NumberEntry*) calloc(ssa->numberCapacity, sizeof(NumberEntry));
+  ssa->lastNumber = 0;
+  freeMap(&ssa->objectNumbers);
+  initMap(&ssa->objectNumbers);
+}
+
+int freshNumber(SSA* ssa) {
+  return ++ ssa->lastNumber;
+}
+
+// The number of tag(left, right); equal operations get equal numbers
+int lookupNumber(SSA* ssa, int tag, int left, int right) {
+  NumberEntry* old;
+  NumberEntry* entry;
+  int oldCapacity, j;
+  unsigned int i;
+
+  if (2 * (ssa->numberCount + 1) > ssa->numberCapacity) {
+    old = ssa->numbers;
+    oldCapacity = ssa->numberCapacity;
+    ssa->numberCapacity *= 2;
+    ssa->numbers = (NumberEntry*) calloc(ssa->numberCapacity, sizeof(NumberEntry));
+    for (j = 0; j < oldCapacity; j ++)
+      if (old[j].number != 0) {
+	i = ((unsigned int) old[j].tag * 31u + (unsigned int) old[j].left) * 2654435761u + (unsigned int) old[j].right;
+	i &= ssa->numberCapacity - 1;
+	while (ssa->numbers[i].number != 0)
+	  i = (i + 1) & (ssa->numberCapacity - 1);
+	ssa->numbers[i] = old[j];
+      }
+    free(old);
+  }
+
+  i = ((unsigned int) tag * 31u + (unsigned int) left) * 2654435761u + (unsigned int) right;
+  i &= ssa->numberCapacity - 1;
+  for (;;) {
+    entry = ssa->numbers + i;
+    if (entry->number == 0) {
+      entry->tag = tag;
+      entry->left = left;
+      entry->right = right;
+      entry->number = freshNumber(ssa);
+      ssa->numberCount ++;
+      return entry->number;
+    }
+    if ((entry->tag == tag) && (entry->left == left) && (entry->right == right))
+      return entry->number;
+    i = (i + 1) & (ssa->numberCapacity - 1);
+  }
+}
+
+int objectNumber(SSA* ssa, Object* obj) {
+  int number = (int) (size_t) mapGet(&ssa->objectNumbers, obj);
+
+  if (number == 0) {
+    number = freshNumber(ssa);
+    mapPut(&ssa->objectNumbers, obj, (void*) (size_t) number);
+  }
+  return number;
+}
+
+int isCommutative(TokenType op) {
+  return (op == SB_PLUS) || (op == SB_TIMES) || (op == SB_EQ) || (op == SB_NEQ);
+}
+
+Value* useOf(SSA* ssa, Expression* exp) {
+  return (Value*) mapGet(&ssa->map, exp);
+}
+
+// Whether an expression is made only of constants and slots, the
+// expressions value numbers can tell equal
+int isNumbered(SSA* ssa, Expression* exp) {
+  switch (exp->kind) {
+  case EXP_CONSTANT:
+    return 1;
+  case EXP_VARIABLE:
+    return (slotOf(ssa, exp->lvalue->object) >= 0) && (useOf(ssa, exp) != NULL);
+  case EXP_NEGATE:
+    return isNumbered(ssa, exp->operand);
+  case EXP_BINARY:
+    for (; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      if (!isNumbered(ssa, exp->binary.right))
+	return 0;
+    return isNumbered(ssa, exp);
+  default:
+    return 0;
+  }
+}
+
+int numberOperation(SSA* ssa, TokenType op, int left, int right) {
+  int t;
+
+  if (isCommutative(op) && (left > right)) {
+    t = left;
+    left = right;
+    right = t;
+  }
+  return lookupNumber(ssa, op, left, right);
+}
+
+int numberExpression(SSA* ssa, Expression* exp) {
+  Chain chain;
+  int number, i;
+
+  switch (exp->kind) {
+  case EXP_CONSTANT:
+    return lookupNumber(ssa, NUMBER_CONSTANT, exp->value, 0);
+  case EXP_VARIABLE:
+    if ((slotOf(ssa, exp->lvalue->object) >= 0) && (useOf(ssa, exp) != NULL))
+      return useOf(ssa, exp)->number;
+    return freshNumber(ssa);
+  case EXP_NEGATE:
+    return lookupNumber(ssa, NUMBER_NEGATE, numberExpression(ssa, exp->operand), 0);
+  case EXP_BINARY:
+    openChain(&chain, exp);
+    number = numberExpression(ssa, chain.nodes[chain.count - 1]->binary.left);
+    for (i = chain.count - 1; i >= 0; i --)
+      number = numberOperation(ssa, chain.nodes[i]->binary.op, number,
+			       numberExpression(ssa, chain.nodes[i]->binary.right));
+    closeChain(&chain);
+    return number;
+  case EXP_SAVE:
+    return numberExpression(ssa, exp->save.operand);
+  default:
+    return freshNumber(ssa);
+  }
+}
+
+// Whether an element's address may be worth keeping. Constant subscripts
+// are left alone: the address is then known when compiling.
+int isNumberedAddress(SSA* ssa, LValue* lvalue) {
+  Expression* index;
+  int constant = 1;
+
+  if ((lvalue->object == NULL) || (lvalue->indexes == NULL))
+    return 0;
+  for (index = lvalue->indexes; index != NULL; index = index->next) {
+    if (!isNumbered(ssa, index))
+      return 0;
+    if (index->kind != EXP_CONSTANT)
+      constant = 0;
+  }
+  return !constant;
+}
+
+// The address of an array element only depends on the array and on the
+// values of the subscripts
+int numberAddress(SSA* ssa, LValue* lvalue) {
+  Expression* index;
+  int number = lookupNumber(ssa, NUMBER_ARRAY, objectNumber(ssa, lvalue->object), 0);
+
+  for (index = lvalue->indexes; index != NULL; index = index->next)
+    number = lookupNumber(ssa, NUMBER_ELEMENT, number, numberExpression(ssa, index));
+  return number;
+}
+
+/******************* Building ******************************/
+
+Value* newValue(enum ValueKind kind, int slot) {
+  Value* v = (Value*) arenaAlloc(compileArena, sizeof(Value));
+
+  v->kind = kind;
+  v->slot = slot;
+  v->exp = NULL;
+  v->st = NULL;
+  v->operands[0] = NULL;
+  v->operands[1] = NULL;
+  v->root = NULL;
+  v->lattice.state = LAT_TOP;
+  v->lattice.constant = 0;
+  v->number = 0;
+  v->removable = 0;
+  v->live = 0;
+  v->owned = NULL;
+  return v;
+}
+
+Region* newRegion(SSA* ssa, Statement* st) {
+  Region* region = (Region*) arenaAlloc(compileArena, sizeof(Region));
+
+  region->phis = NULL;
+  region->phiCount = 0;
+  region->executable[0] = 0;
+  region->executable[1] = 0;
+  region->start = NULL;
+  region->head = NULL;
+  region->step = NULL;
+  mapPut(&ssa->map, st, region);
+  return region;
+}
+
+Value** copyDefs(SSA* ssa, Value** defs) {
+  Value** copy = (Value**) malloc((ssa->slotCount + 1) * sizeof(Value*));
+
+  memcpy(copy, defs, ssa->slotCount * sizeof(Value*));
+  return copy;
+}
+
+void addUse(SSA* ssa, Value* value) {
+  Use* use = (Use*) arenaAlloc(compileArena, sizeof(Use));
+
+  use->value = value;
+  if (ssa->owner != NULL) {
+    use->next = ssa->owner->owned;
+    ssa->owner->owned = use;
+  } else {
+    use->next = ssa->essential;
+    ssa->essential = use;
+  }
+}
+
+void propagateCopy(SSA* ssa, Expression* exp, Value** defs);
+
+void useSlot(SSA* ssa, Expression* exp, int slot, Value** defs) {
+  if (ssa->replaying) {
+    propagateCopy(ssa, exp, defs);
+    return;
+  }
+  mapPut(&ssa->map, exp, defs[slot]);
+  addUse(ssa, defs[slot]);
+}
+
+void walkLValue(SSA* ssa, LValue* lvalue, Value** defs) {
+  Expression* index;
+
+  if (lvalue->object == NULL)
+    walkExpression(ssa, lvalue->address, defs);
+  else
+    for (index = lvalue->indexes; index != NULL; index = index->next)
+      walkExpression(ssa, index, defs);
+}
+
+void walkExpression(SSA* ssa, Expression* exp, Value** defs) {
+  Expression* arg;
+  Value* owner;
+  Chain chain;
+  int slot, i;
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+    slot = slotOf(ssa, exp->lvalue->object);
+    if (slot >= 0)
+      useSlot(ssa, exp, slot, defs);
+    else walkLValue(ssa, exp->lvalue, defs);
+    break;
+  case EXP_REFERENCE:
+    walkLValue(ssa, exp->lvalue, defs);
+    break;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      walkExpression(ssa, arg, defs);
+    break;
+  case EXP_NEGATE:
+    walkExpression(ssa, exp->operand, defs);
+    break;
+  case EXP_BINARY:
+    openChain(&chain, exp);
+    walkExpression(ssa, chain.nodes[chain.count - 1]->binary.left, defs);
+    for (i = chain.count - 1; i >= 0; i --)
+      walkExpression(ssa, chain.nodes[i]->binary.right, defs);
+    closeChain(&chain);
+    break;
+  case EXP_SAVE:
+    walkExpression(ssa, exp->save.operand, defs);
+    break;
+  case EXP_INLINE:
+    // The assignments of the body own what they read
+    owner = ssa->owner;
+    walkStatement(ssa, exp->inlined.body, defs);
+    ssa->owner = owner;
+    walkExpression(ssa, exp->inlined.value, defs);
+    break;
+  default:
+    break;
+  }
+}
+
+void markAssigned(SSA* ssa, int slot) {
+  if ((slot >= 0) && (ssa->marks[slot] != ssa->generation)) {
+    ssa->marks[slot] = ssa->generation;
+    ssa->assigned[ssa->assignedCount ++] = slot;
+  }
+}
+
+void collectAssigned(SSA* ssa, Statement* st);
+
+void collectAssignedAt(SSA* ssa, LValue* lvalue);
+
+// An inlined function call in an expression assigns temporaries too
+void collectAssignedIn(SSA* ssa, Expression* exp) {
+  Expression* operand;
+
+  for (; exp != NULL; exp = exp->next)
+    switch (exp->kind) {
+    case EXP_VARIABLE:
+    case EXP_REFERENCE:
+      collectAssignedAt(ssa, exp->lvalue);
+      break;
+    case EXP_CALL:
+      collectAssignedIn(ssa, exp->call.arguments);
+      break;
+    case EXP_NEGATE:
+      collectAssignedIn(ssa, exp->operand);
+      break;
+    case EXP_BINARY:
+      for (operand = exp; operand->kind == EXP_BINARY; operand = operand->binary.left)
+	collectAssignedIn(ssa, operand->binary.right);
+      collectAssignedIn(ssa, operand);
+      break;
+    case EXP_SAVE:
+      collectAssignedIn(ssa, exp->save.operand);
+      break;
+    case EXP_INLINE:
+      collectAssigned(ssa, exp->inlined.body);
+      collectAssignedIn(ssa, exp->inlined.value);
+      break;
+    default:
+      break;
+    }
+}
+
+void collectAssignedAt(SSA* ssa, LValue* lvalue) {
+  if (lvalue->object == NULL)
+    collectAssignedIn(ssa, lvalue->address);
+  else collectAssignedIn(ssa, lvalue->indexes);
+}
+
+void collectAssigned(SSA* ssa, Statement* st) {
+  Statement* s;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    markAssigned(ssa, slotOf(ssa, st->assign.lvalue->object));
+    collectAssignedAt(ssa, st->assign.lvalue);
+    collectAssignedIn(ssa, st->assign.value);
+    break;
+  case ST_CALL:
+    collectAssignedIn(ssa, st->call.arguments);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      collectAssigned(ssa, s);
+    break;
+  case ST_IF:
+    collectAssignedIn(ssa, st->ifSt.condition);
+    collectAssigned(ssa, st->ifSt.thenPart);
+    collectAssigned(ssa, st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+    collectAssignedIn(ssa, st->whileSt.condition);
+    collectAssigned(ssa, st->whileSt.body);
+    break;
+  case ST_FOR:
+    markAssigned(ssa, slotOf(ssa, st->forSt.variable->object));
+    collectAssignedAt(ssa, st->forSt.variable);
+    collectAssignedIn(ssa, st->forSt.from);
+    collectAssignedIn(ssa, st->forSt.to);
+    collectAssigned(ssa, st->forSt.body);
+    break;
+  }
+}
+
+// The phis after an IF, for the slots its branches leave different
+Region* joinRegion(SSA* ssa, Statement* st, Value** thenDefs, Value** elseDefs) {
+  Region* region = newRegion(ssa, st);
+  Value* phi;
+  int slot;
+
+  for (slot = 0; slot < ssa->slotCount; slot ++)
+    if (thenDefs[slot] != elseDefs[slot])
+      region->phiCount ++;
+  region->phis = (Value**) arenaAlloc(compileArena, (region->phiCount + 1) * sizeof(Value*));
+  region->phiCount = 0;
+  for (slot = 0; slot < ssa->slotCount; slot ++)
+    if (thenDefs[slot] != elseDefs[slot]) {
+      phi = newValue(VAL_JOIN, slot);
+      phi->operands[0] = thenDefs[slot];
+      phi->operands[1] = elseDefs[slot];
+      if (thenDefs[slot]->number == elseDefs[slot]->number)
+	phi->number = thenDefs[slot]->number;
+      else phi->number = freshNumber(ssa);
+      region->phis[region->phiCount ++] = phi;
+    }
+  return region;
+}
+
+// The phis at the head of a loop, for the slots its body assigns. A FOR
+// over a slot first gives it the start value.
+Region* loopRegion(SSA* ssa, Statement* st, Statement* body, int slot, Expression* from, Value** defs) {
+  Region* region;
+  Value* phi;
+  int i;
+
+  if (ssa->replaying) {
+    region = (Region*) mapGet(&ssa->map, st);
+    if (slot >= 0)
+      defs[slot] = region->start;
+    return region;
+  }
+
+  region = newRegion(ssa, st);
+  if (slot >= 0) {
+    region->start = newValue(VAL_DEF, slot);
+    region->start->exp = from;
+    region->start->number = numberExpression(ssa, from);
+    defs[slot] = region->start;
+  }
+
+  ssa->generation ++;
+  ssa->assignedCount = 0;
+  markAssigned(ssa, slot);
+  if (st->kind == ST_WHILE)
+    collectAssignedIn(ssa, st->whileSt.condition);
+  collectAssigned(ssa, body);
+
+  region->phis = (Value**) arenaAlloc(compileArena, (ssa->assignedCount + 1) * sizeof(Value*));
+  region->phiCount = ssa->assignedCount;
+  for (i = 0; i < ssa->assignedCount; i ++) {
+    phi = newValue(VAL_LOOP, ssa->assigned[i]);
+    phi->operands[0] = defs[phi->slot];
+    phi->number = freshNumber(ssa);
+    region->phis[i] = phi;
+    if (phi->slot == slot)
+      region->head = phi;
+  }
+  return region;
+}
+
+void enterRegion(Region* region, Value** defs) {
+  int i;
+
+  for (i = 0; i < region->phiCount; i ++)
+    defs[region->phis[i]->slot] = region->phis[i];
+}
+
+void closeLoop(SSA* ssa, Region* region, Value** bodyDefs) {
+  int i;
+
+  if (!ssa->replaying)
+    for (i = 0; i < region->phiCount; i ++)
+      region->phis[i]->operands[1] = bodyDefs[region->phis[i]->slot];
+}
+
+// Builds the SSA form of st, or walks it again, with defs holding the
+// value of each slot on the way in and on the way out
+void walkStatement(SSA* ssa, Statement* st, Value** defs) {
+  Expression* arg;
+  Statement* s;
+  Region* region;
+  Value** branchDefs;
+  Value* v;
+  int slot;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    walkLValue(ssa, st->assign.lvalue, defs);
+    slot = slotOf(ssa, st->assign.lvalue->object);
+    if (slot < 0) {
+      walkExpression(ssa, st->assign.value, defs);
+      break;
+    }
+    if (ssa->replaying)
+      v = (Value*) mapGet(&ssa->map, st);
+    else {
+      v = newValue(VAL_DEF, slot);
+      v->exp = st->assign.value;
+      v->st = st;
+      v->removable = isPureExpression(v->exp);
+      mapPut(&ssa->map, st, v);
+      if (v->removable)
+	ssa->owner = v;
+    }
+    walkExpression(ssa, st->assign.value, defs);
+    ssa->owner = NULL;
+    if (!ssa->replaying)
+      v->number = numberExpression(ssa, v->exp);
+    defs[slot] = v;
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      walkExpression(ssa, arg, defs);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      walkStatement(ssa, s, defs);
+    break;
+  case ST_IF:
+    walkExpression(ssa, st->ifSt.condition, defs);
+    branchDefs = copyDefs(ssa, defs);
+    walkStatement(ssa, st->ifSt.thenPart, branchDefs);
+    walkStatement(ssa, st->ifSt.elsePart, defs);
+    if (ssa->replaying)
+      region = (Region*) mapGet(&ssa->map, st);
+    else region = joinRegion(ssa, st, branchDefs, defs);
+    enterRegion(region, defs);
+    free(branchDefs);
+    break;
+  case ST_WHILE:
+    region = loopRegion(ssa, st, st->whileSt.body, -1, NULL, defs);
+    enterRegion(region, defs);
+    walkExpression(ssa, st->whileSt.condition, defs);
+    branchDefs = copyDefs(ssa, defs);
+    walkStatement(ssa, st->whileSt.body, branchDefs);
+    closeLoop(ssa, region, branchDefs);
+    free(branchDefs);
+    break;
+  case ST_FOR:
+    // The bound is evaluated once, before the variable gets its start
+    // value; the loop itself tests and steps the variable in its slot
+    walkLValue(ssa, st->forSt.variable, defs);
+    walkExpression(ssa, st->forSt.from, defs);
+    walkExpression(ssa, st->forSt.to, defs);
+    slot = slotOf(ssa, st->forSt.variable->object);
+    region = loopRegion(ssa, st, st->forSt.body, slot, st->forSt.from, defs);
+    enterRegion(region, defs);
+    branchDefs = copyDefs(ssa, defs);
+    walkStatement(ssa, st->forSt.body, branchDefs);
+    if (slot >= 0) {
+      if (!ssa->replaying) {
+	ssa->owner = NULL;
+	addUse(ssa, region->head);
+	addUse(ssa, branchDefs[slot]);
+	region->step = newValue(VAL_STEP, slot);
+	region->step->operands[0] = branchDefs[slot];
+	region->step->number = lookupNumber(ssa, SB_PLUS, lookupNumber(ssa, NUMBER_CONSTANT, 1, 0),
+					     branchDefs[slot]->number);
+      }
+      branchDefs[slot] = region->step;
+    }
+    closeLoop(ssa, region, branchDefs);
+    free(branchDefs);
+    break;
+  }
+}
+
+void buildSSA(SSA* ssa, Block* block) {
+  Value** defs;
+  Statement* s;
+  int slot;
+
+  freeMap(&ssa->map);
+  initMap(&ssa->map);
+  resetNumbers(ssa);
+  ssa->replaying = 0;
+  ssa->owner = NULL;
+  ssa->essential = NULL;
+
+  for (slot = 0; slot < ssa->slotCount; slot ++) {
+    ssa->entries[slot] = newValue(VAL_ENTRY, slot);
+    ssa->entries[slot]->lattice.state = LAT_BOTTOM;
+    ssa->entries[slot]->number = freshNumber(ssa);
+  }
+  defs = copyDefs(ssa, ssa->entries);
+  for (s = block->body; s != NULL; s = s->next)
+    walkStatement(ssa, s, defs);
+  free(defs);
+}
+
+void replaySSA(SSA* ssa, Block* block) {
+  Value** defs = copyDefs(ssa, ssa->entries);
+  Statement* s;
+
+  ssa->replaying = 1;
+  for (s = block->body; s != NULL; s = s->next)
+    walkStatement(ssa, s, defs);
+  ssa->replaying = 0;
+  free(defs);
+}
+
+// Makes st do what by does; by may be NULL for nothing
+void replaceStatement(Statement* st, Statement* by) {
+  Statement* next = st->next;
+
+  if (by == NULL) {
+    st->kind = ST_GROUP;
+    st->body = NULL;
+  } else *st = *by;
+  st->next = next;
+}
+
+/******************* Constant propagation ******************************/
+
+void meet(Lattice* l, Lattice* other) {
+  if (other->state == LAT_TOP)
+    return;
+  if (l->state == LAT_TOP)
+    *l = *other;
+  else if ((l->state == LAT_CONST) &&
+	   ((other->state != LAT_CONST) || (other->constant != l->constant)))
+    l->state = LAT_BOTTOM;
+}
+
+void combine(TokenType op, Lattice* left, Lattice* right, Lattice* result) {
+  Lattice l;
+
+  if ((left->state == LAT_BOTTOM) || (right->state == LAT_BOTTOM))
+    l.state = LAT_BOTTOM;
+  else if ((left->state == LAT_TOP) || (right->state == LAT_TOP))
+    l.state = LAT_TOP;
+  else if (foldOperator(op, left->constant, right->constant, &l.constant))
+    l.state = LAT_CONST;
+  else l.state = LAT_BOTTOM;
+  *result = l;
+}
+
+int canBeTrue(Lattice* l) {
+  return (l->state != LAT_CONST) || (l->constant != 0);
+}
+
+int canBeFalse(Lattice* l) {
+  return (l->state != LAT_CONST) || (l->constant == 0);
+}
+
+void evalStatement(SSA* ssa, Statement* st);
+void evalLValue(SSA* ssa, LValue* lvalue);
+
+// Evaluates every operand, even of an expression whose value is unknown,
+// as inlined calls in it assign temporaries and variables
+void evalExpression(SSA* ssa, Expression* exp, Lattice* result) {
+  Expression* arg;
+  Lattice right;
+  Value* v;
+  Chain chain;
+  int i;
+
+  switch (exp->kind) {
+  case EXP_CONSTANT:
+    result->state = LAT_CONST;
+    result->constant = exp->value;
+    return;
+  case EXP_VARIABLE:
+    if (slotOf(ssa, exp->lvalue->object) >= 0) {
+      v = useOf(ssa, exp);
+      if (v != NULL) {
+	*result = v->lattice;
+	return;
+      }
+    }
+    evalLValue(ssa, exp->lvalue);
+    break;
+  case EXP_REFERENCE:
+    evalLValue(ssa, exp->lvalue);
+    break;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      evalExpression(ssa, arg, &right);
+    break;
+  case EXP_SAVE:
+    evalExpression(ssa, exp->save.operand, &right);
+    break;
+  case EXP_NEGATE:
+    evalExpression(ssa, exp->operand, result);
+    if (result->state == LAT_CONST)
+      result->constant = foldNegate(result->constant);
+    return;
+  case EXP_BINARY:
+    openChain(&chain, exp);
+    evalExpression(ssa, chain.nodes[chain.count - 1]->binary.left, result);
+    for (i = chain.count - 1; i >= 0; i --) {
+      evalExpression(ssa, chain.nodes[i]->binary.right, &right);
+      combine(chain.nodes[i]->binary.op, result, &right, result);
+    }
+    closeChain(&chain);
+    return;
+  case EXP_INLINE:
+    // Only a body without effects may go with the call it replaced
+    evalStatement(ssa, exp->inlined.body);
+    evalExpression(ssa, exp->inlined.value, result);
+    if (!exp->inlined.pure)
+      result->state = LAT_BOTTOM;
+    return;
+  default:
+    break;
+  }
+  result->state = LAT_BOTTOM;
+}
+
+// Meets the values reaching each phi along the edges that may run.
+// Returns whether some phi changed.
+int meetPhis(Region* region, int first, int second) {
+  Lattice l;
+  Value* phi;
+  int i, changed = 0;
+
+  for (i = 0; i < region->phiCount; i ++) {
+    phi = region->phis[i];
+    l.state = LAT_TOP;
+    l.constant = 0;
+    if (first) meet(&l, &phi->operands[0]->lattice);
+    if (second) meet(&l, &phi->operands[1]->lattice);
+    if ((l.state != phi->lattice.state) ||
+	((l.state == LAT_CONST) && (l.constant != phi->lattice.constant)))
+      changed = 1;
+    phi->lattice = l;
+  }
+  return changed;
+}
+
+// Evaluates the subscripts of an lvalue, for the inlined calls in them
+void evalLValue(SSA* ssa, LValue* lvalue) {
+  Expression* index;
+  Lattice l;
+
+  if (lvalue->object == NULL)
+    evalExpression(ssa, lvalue->address, &l);
+  else
+    for (index = lvalue->indexes; index != NULL; index = index->next)
+      evalExpression(ssa, index, &l);
+}
+
+// Evaluates a statement that may run. Values only ever move down the
+// lattice, so a loop is evaluated again until its phis stop changing.
+void evalStatement(SSA* ssa, Statement* st) {
+  Expression* arg;
+  Statement* s;
+  Region* region;
+  Value* v;
+  Lattice l, limit, one;
+
+  if ((st == NULL) || ssa->failed)
+    return;
+  if (-- ssa->budget < 0) {
+    ssa->failed = 1;
+    return;
+  }
+
+  switch (st->kind) {
+  case ST_ASSIGN:
+    evalLValue(ssa, st->assign.lvalue);
+    if (slotOf(ssa, st->assign.lvalue->object) >= 0) {
+      v = (Value*) mapGet(&ssa->map, st);
+      evalExpression(ssa, st->assign.value, &v->lattice);
+    } else evalExpression(ssa, st->assign.value, &l);
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      evalExpression(ssa, arg, &l);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      evalStatement(ssa, s);
+    break;
+  case ST_IF:
+    region = (Region*) mapGet(&ssa->map, st);
+    evalExpression(ssa, st->ifSt.condition, &l);
+    if (canBeTrue(&l)) region->executable[0] = 1;
+    if (canBeFalse(&l)) region->executable[1] = 1;
+    if (region->executable[0])
+      evalStatement(ssa, st->ifSt.thenPart);
+    if (region->executable[1])
+      evalStatement(ssa, st->ifSt.elsePart);
+    meetPhis(region, region->executable[0], region->executable[1]);
+    break;
+  case ST_WHILE:
+    region = (Region*) mapGet(&ssa->map, st);
+    meetPhis(region, 1, region->executable[0]);
+    do {
+      evalExpression(ssa, st->whileSt.condition, &l);
+      if (canBeTrue(&l)) region->executable[0] = 1;
+      if (!region->executable[0])
+	break;
+      evalStatement(ssa, st->whileSt.body);
+    } while (meetPhis(region, 1, 1) && !ssa->failed);
+    break;
+  case ST_FOR:
+    region = (Region*) mapGet(&ssa->map, st);
+    evalLValue(ssa, st->forSt.variable);
+    if (region->start != NULL)
+      evalExpression(ssa, st->forSt.from, &region->start->lattice);
+    else evalExpression(ssa, st->forSt.from, &l);
+    evalExpression(ssa, st->forSt.to, &limit);
+    meetPhis(region, 1, region->executable[0]);
+    one.state = LAT_CONST;
+    one.constant = 1;
+    do {
+      if (region->head != NULL)
+	combine(SB_LE, &region->head->lattice, &limit, &l);
+      else l.state = LAT_BOTTOM;
+      if (canBeTrue(&l)) region->executable[0] = 1;
+      if (!region->executable[0])
+	break;
+      evalStatement(ssa, st->forSt.body);
+      if (region->step != NULL)
+	combine(SB_PLUS, &region->step->operands[0]->lattice, &one, &region->step->lattice);
+    } while (meetPhis(region, 1, 1) && !ssa->failed);
+    break;
+  default:
+    break;
+  }
+}
+
+void foldExpression(SSA* ssa, Expression* exp);
+void foldStatement(SSA* ssa, Statement* st);
+
+void foldLValue(SSA* ssa, LValue* lvalue) {
+  Expression* index;
+
+  if (lvalue->object == NULL)
+    foldExpression(ssa, lvalue->address);
+  else
+    for (index = lvalue->indexes; index != NULL; index = index->next)
+      foldExpression(ssa, index);
+}
+
+// A chain is evaluated once, from the first operand up. Its topmost
+// constant node is folded, then the right operands above it are folded on
+// their own, from the lowest up.
+void foldChain(SSA* ssa, Expression* exp) {
+  Chain chain;
+  Lattice* values;              // values[i] is that of chain.nodes[i]
+  Lattice left, right;
+  int i;
+
+  openChain(&chain, exp);
+  values = (Lattice*) malloc(chain.count * sizeof(Lattice));
+  evalExpression(ssa, chain.nodes[chain.count - 1]->binary.left, &left);
+  for (i = chain.count - 1; i >= 0; i --) {
+    evalExpression(ssa, chain.nodes[i]->binary.right, &right);
+    combine(chain.nodes[i]->binary.op, &left, &right, values + i);
+    left = values[i];
+  }
+
+  for (i = 0; (i < chain.count) && (values[i].state != LAT_CONST); i ++)
+    ;
+  if (i < chain.count) {
+    chain.nodes[i]->kind = EXP_CONSTANT;
+    chain.nodes[i]->value = values[i].constant;
+  } else foldExpression(ssa, chain.nodes[i - 1]->binary.left);
+  for (i --; i >= 0; i --)
+    foldExpression(ssa, chain.nodes[i]->binary.right);
+  free(values);
+  closeChain(&chain);
+}
+
+// Replaces the largest constant parts of an expression by their values
+void foldExpression(SSA* ssa, Expression* exp) {
+  Expression* arg;
+  Lattice l;
+
+  if (exp->kind == EXP_CONSTANT)
+    return;
+  if (exp->kind == EXP_BINARY) {
+    foldChain(ssa, exp);
+    return;
+  }
+  evalExpression(ssa, exp, &l);
+  if (l.state == LAT_CONST) {
+    exp->kind = EXP_CONSTANT;
+    exp->value = l.constant;
+    return;
+  }
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    foldLValue(ssa, exp->lvalue);
+    break;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      foldExpression(ssa, arg);
+    break;
+  case EXP_NEGATE:
+    foldExpression(ssa, exp->operand);
+    break;
+  case EXP_SAVE:
+    foldExpression(ssa, exp->save.operand);
+    break;
+  case EXP_INLINE:
+    foldStatement(ssa, exp->inlined.body);
+    foldExpression(ssa, exp->inlined.value);
+    break;
+  default:
+    break;
+  }
+}
+
+// Rewrites a statement that may run. A branch or a loop body that never
+// runs goes; its condition was constant, so nothing else goes with it.
+void foldStatement(SSA* ssa, Statement* st) {
+  Expression* arg;
+  Statement* s;
+  Statement* by;
+  Region* region;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    foldLValue(ssa, st->assign.lvalue);
+    foldExpression(ssa, st->assign.value);
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      foldExpression(ssa, arg);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      foldStatement(ssa, s);
+    break;
+  case ST_IF:
+    region = (Region*) mapGet(&ssa->map, st);
+    if (!region->executable[1]) {
+      foldStatement(ssa, st->ifSt.thenPart);
+      replaceStatement(st, st->ifSt.thenPart);
+    } else if (!region->executable[0]) {
+      foldStatement(ssa, st->ifSt.elsePart);
+      replaceStatement(st, st->ifSt.elsePart);
+    } else {
+      foldExpression(ssa, st->ifSt.condition);
+      foldStatement(ssa, st->ifSt.thenPart);
+      foldStatement(ssa, st->ifSt.elsePart);
+    }
+    break;
+  case ST_WHILE:
+    region = (Region*) mapGet(&ssa->map, st);
+    if (!region->executable[0])
+      replaceStatement(st, NULL);
+    else {
+      foldExpression(ssa, st->whileSt.condition);
+      foldStatement(ssa, st->whileSt.body);
+    }
+    break;
+  case ST_FOR:
+    region = (Region*) mapGet(&ssa->map, st);
+    if (!region->executable[0]) {
+      // The variable still gets its start value
+      by = makeAssignStatement(st->forSt.variable, st->forSt.from);
+      foldStatement(ssa, by);
+      replaceStatement(st, by);
+    } else {
+      foldLValue(ssa, st->forSt.variable);
+      foldExpression(ssa, st->forSt.from);
+      foldExpression(ssa, st->forSt.to);
+      foldStatement(ssa, st->forSt.body);
+    }
+    break;
+  }
+}
+
+/******************* Loop-invariant code ******************************/
+
+// What a loop may change, beside the slots marked in this generation
+struct Loop_ {
+  int clobbers;                 // a call, or a store that may reach memory
+                                //   outside the block's frame
+  int storesFrame;              // a store to the frame, not to a slot
+  Statement* first;             // what is computed before the loop, as
+  Statement* last;              //   assignments to temporaries
+};
+
+typedef struct Loop_ Loop;
+
+void scanExpression(SSA* ssa, Loop* loop, Expression* exp);
+void scanStatement(SSA* ssa, Loop* loop, Statement* st);
+
+void scanStore(SSA* ssa, Loop* loop, LValue* lvalue) {
+  Object* obj = lvalue->object;
+  int slot = slotOf(ssa, obj);
+
+  if (slot >= 0)
+    markAssigned(ssa, slot);
+  else if ((obj == NULL) ||
+	   ((obj->kind == OBJ_PARAMETER) && (obj->paramAttrs.kind == PARAM_REFERENCE)) ||
+	   ((obj->kind == OBJ_PARAMETER) && (obj->paramAttrs.scope != ssa->scope)) ||
+	   ((obj->kind == OBJ_VARIABLE) && (obj->varAttrs.scope != ssa->scope)))
+    loop->clobbers = 1;
+  else loop->storesFrame = 1;
+}
+
+void scanLValue(SSA* ssa, Loop* loop, LValue* lvalue) {
+  Expression* index;
+
+  if (lvalue->object == NULL)
+    scanExpression(ssa, loop, lvalue->address);
+  for (index = lvalue->indexes; index != NULL; index = index->next)
+    scanExpression(ssa, loop, index);
+}
+
+void scanExpression(SSA* ssa, Loop* loop, Expression* exp) {
+  Expression* arg;
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    scanLValue(ssa, loop, exp->lvalue);
+    break;
+  case EXP_CALL:
+    if (!isPredefinedFunction(exp->call.function))
+      loop->clobbers = 1;
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      scanExpression(ssa, loop, arg);
+    break;
+  case EXP_NEGATE:
+    scanExpression(ssa, loop, exp->operand);
+    break;
+  case EXP_BINARY:
+    for (; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      scanExpression(ssa, loop, exp->binary.right);
+    scanExpression(ssa, loop, exp);
+    break;
+  case EXP_SAVE:
+    loop->storesFrame = 1;
+    scanExpression(ssa, loop, exp->save.operand);
+    break;
+  case EXP_INLINE:
+    scanStatement(ssa, loop, exp->inlined.body);
+    scanExpression(ssa, loop, exp->inlined.value);
+    break;
+  default:
+    break;
+  }
+}
+
+// Collects what a loop changes: the slots it assigns, and whether it
+// stores to memory
+void scanStatement(SSA* ssa, Loop* loop, Statement* st) {
+  Expression* arg;
+  Statement* s;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    scanStore(ssa, loop, st->assign.lvalue);
+    scanLValue(ssa, loop, st->assign.lvalue);
+    scanExpression(ssa, loop, st->assign.value);
+    break;
+  case ST_CALL:
+    if (!isPredefinedProcedure(st->call.procedure))
+      loop->clobbers = 1;
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      scanExpression(ssa, loop, arg);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      scanStatement(ssa, loop, s);
+    break;
+  case ST_IF:
+    scanExpression(ssa, loop, st->ifSt.condition);
+    scanStatement(ssa, loop, st->ifSt.thenPart);
+    scanStatement(ssa, loop, st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+    scanExpression(ssa, loop, st->whileSt.condition);
+    scanStatement(ssa, loop, st->whileSt.body);
+    break;
+  case ST_FOR:
+    scanStore(ssa, loop, st->forSt.variable);
+    scanLValue(ssa, loop, st->forSt.variable);
+    scanExpression(ssa, loop, st->forSt.from);
+    scanExpression(ssa, loop, st->forSt.to);
+    scanStatement(ssa, loop, st->forSt.body);
+    break;
+  }
+}
+
+// Whether a scalar reads the same on every trip round the loop. A
+// reference parameter points outside the frame, so only a call or a
+// store outside the frame may change what it reads.
+int isInvariantRead(SSA* ssa, Loop* loop, Object* obj) {
+  int slot = slotOf(ssa, obj);
+
+  if (slot >= 0)
+    return ssa->marks[slot] != ssa->generation;
+  if (loop->clobbers)
+    return 0;
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+    return (obj->varAttrs.scope != ssa->scope) || !loop->storesFrame;
+  case OBJ_PARAMETER:
+    return (obj->paramAttrs.kind == PARAM_REFERENCE) ||
+      (obj->paramAttrs.scope != ssa->scope) || !loop->storesFrame;
+  default:
+    return 0;
+  }
+}
+
+// Whether an expression may be computed once before the loop instead:
+// it is pure, and what it reads does not change in the loop. Array
+// elements are not read ahead, as their subscripts may be out of range
+// when the loop would not have read them.
+int isInvariant(SSA* ssa, Loop* loop, Expression* exp) {
+  switch (exp->kind) {
+  case EXP_CONSTANT:
+    return 1;
+  case EXP_VARIABLE:
+    if ((exp->lvalue->object == NULL) || (exp->lvalue->indexes != NULL))
+      return 0;
+    return isInvariantRead(ssa, loop, exp->lvalue->object);
+  case EXP_NEGATE:
+    return isInvariant(ssa, loop, exp->operand);
+  case EXP_BINARY:
+    for (; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      if (mayFail(exp) || !isInvariant(ssa, loop, exp->binary.right))
+	return 0;
+    return isInvariant(ssa, loop, exp);
+  default:
+    return 0;
+  }
+}
+
+// The instructions an invariant expression compiles to
+int invariantCost(Expression* exp) {
+  Object* obj;
+  int cost;
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+    obj = exp->lvalue->object;
+    if (obj == NULL)              // an element at an address already computed
+      return invariantCost(exp->lvalue->address) + 1;
+    if ((obj->kind == OBJ_PARAMETER) && (obj->paramAttrs.kind == PARAM_REFERENCE))
+      return 2;
+    return 1;
+  case EXP_NEGATE:
+    return invariantCost(exp->operand) + 1;
+  case EXP_BINARY:
+    for (cost = 0; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      cost += invariantCost(exp->binary.right) + 1;
+    return cost + invariantCost(exp);
+  default:
+    return 1;
+  }
+}
+
+int sameExpression(Expression* a, Expression* b);
+
+int sameLValue(LValue* a, LValue* b) {
+  Expression* i;
+  Expression* j;
+
+  if (a->object != b->object)
+    return 0;
+  if (a->object == NULL)
+    return sameExpression(a->address, b->address);
+  for (i = a->indexes, j = b->indexes; (i != NULL) && (j != NULL); i = i->next, j = j->next)
+    if (!sameExpression(i, j))
+      return 0;
+  return (i == NULL) && (j == NULL);
+}
+
+int sameExpression(Expression* a, Expression* b) {
+  if (a->kind != b->kind)
+    return 0;
+  switch (a->kind) {
+  case EXP_CONSTANT:
+    return a->value == b->value;
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    return sameLValue(a->lvalue, b->lvalue);
+  case EXP_NEGATE:
+    return sameExpression(a->operand, b->operand);
+  case EXP_BINARY:
+    for (; (a->kind == EXP_BINARY) && (b->kind == EXP_BINARY); a = a->binary.left, b = b->binary.left)
+      if ((a->binary.op != b->binary.op) || !sameExpression(a->binary.right, b->binary.right))
+	return 0;
+    return sameExpression(a, b);
+  default:
+    return 0;
+  }
+}
+
+// The temporary that keeps exp, computed before the loop. Equal
+// expressions of a loop share one.
+Object* hoist(SSA* ssa, Loop* loop, Expression* exp) {
+  Statement* st;
+
+  for (st = loop->first; st != NULL; st = st->next)
+    if (sameExpression(st->assign.value, exp))
+      return st->assign.lvalue->object;
+
+  st = makeAssignStatement(makeLValue(createTemporaryObject(ssa->scope, intType), NULL, intType), exp);
+  if (loop->first == NULL)
+    loop->first = st;
+  else loop->last->next = st;
+  loop->last = st;
+  return st->assign.lvalue->object;
+}
+
+Expression* readTemp(Object* temp) {
+  return makeVariableExpression(makeLValue(temp, NULL, intType));
+}
+
+void hoistExpression(SSA* ssa, Loop* loop, Expression* exp);
+void hoistStatement(SSA* ssa, Loop* loop, Statement* st);
+
+// The address of an element whose subscripts do not change is computed
+// before the loop; the element itself is still read or written in it
+void hoistLValue(SSA* ssa, Loop* loop, LValue* lvalue) {
+  Expression* index;
+  Expression* reference;
+  int invariant = 1;
+  int constant = 1;
+
+  if (lvalue->object == NULL) {
+    hoistExpression(ssa, loop, lvalue->address);
+    return;
+  }
+  for (index = lvalue->indexes; index != NULL; index = index->next) {
+    if (!isInvariant(ssa, loop, index))
+      invariant = 0;
+    if (index->kind != EXP_CONSTANT)
+      constant = 0;
+  }
+  if (invariant && !constant) {
+    reference = makeReferenceExpression(makeLValue(lvalue->object, lvalue->indexes, lvalue->type));
+    lvalue->address = readTemp(hoist(ssa, loop, reference));
+    lvalue->object = NULL;
+    lvalue->indexes = NULL;
+    return;
+  }
+  for (index = lvalue->indexes; index != NULL; index = index->next)
+    hoistExpression(ssa, loop, index);
+}
+
+void hoistInvariant(SSA* ssa, Loop* loop, Expression* exp) {
+  Expression* copy = (Expression*) arenaAlloc(compileArena, sizeof(Expression));
+
+  *copy = *exp;
+  copy->next = NULL;
+  exp->kind = EXP_VARIABLE;
+  exp->lvalue = makeLValue(hoist(ssa, loop, copy), NULL, exp->type);
+}
+
+// The nodes of a chain that are invariant are those below some node,
+// whose cost is the largest of them: it is the one worth hoisting, if any.
+// Right operands above it are then hoisted on their own, from the
+// lowest up as they are evaluated.
+void hoistChain(SSA* ssa, Loop* loop, Expression* exp) {
+  Chain chain;
+  Expression* node;
+  int invariant, cost, i;
+
+  openChain(&chain, exp);
+  node = chain.nodes[chain.count - 1]->binary.left;
+  invariant = isInvariant(ssa, loop, node);
+  cost = invariant ? invariantCost(node) : 0;
+  for (i = chain.count - 1; invariant && (i >= 0); i --) {
+    node = chain.nodes[i];
+    if (mayFail(node) || !isInvariant(ssa, loop, node->binary.right))
+      break;
+    cost += invariantCost(node->binary.right) + 1;
+  }
+  i ++;                         // the topmost invariant node, or count
+
+  if ((i < chain.count) && (cost >= LICM_MINIMUM_COST))
+    hoistInvariant(ssa, loop, chain.nodes[i]);
+  else {
+    i = chain.count;
+    hoistExpression(ssa, loop, chain.nodes[i - 1]->binary.left);
+  }
+  for (i --; i >= 0; i --)
+    hoistExpression(ssa, loop, chain.nodes[i]->binary.right);
+  closeChain(&chain);
+}
+
+void hoistExpression(SSA* ssa, Loop* loop, Expression* exp) {
+  Expression* arg;
+
+  if (exp->kind == EXP_BINARY) {
+    hoistChain(ssa, loop, exp);
+    return;
+  }
+  if (isInvariant(ssa, loop, exp) && (invariantCost(exp) >= LICM_MINIMUM_COST)) {
+    hoistInvariant(ssa, loop, exp);
+    return;
+  }
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    hoistLValue(ssa, loop, exp->lvalue);
+    break;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      hoistExpression(ssa, loop, arg);
+    break;
+  case EXP_NEGATE:
+    hoistExpression(ssa, loop, exp->operand);
+    break;
+  case EXP_SAVE:
+    hoistExpression(ssa, loop, exp->save.operand);
+    break;
+  case EXP_INLINE:
+    hoistStatement(ssa, loop, exp->inlined.body);
+    hoistExpression(ssa, loop, exp->inlined.value);
+    break;
+  default:
+    break;
+  }
+}
+
+void hoistStatement(SSA* ssa, Loop* loop, Statement* st) {
+  Expression* arg;
+  Statement* s;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    hoistLValue(ssa, loop, st->assign.lvalue);
+    hoistExpression(ssa, loop, st->assign.value);
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      hoistExpression(ssa, loop, arg);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      hoistStatement(ssa, loop, s);
+    break;
+  case ST_IF:
+    hoistExpression(ssa, loop, st->ifSt.condition);
+    hoistStatement(ssa, loop, st->ifSt.thenPart);
+    hoistStatement(ssa, loop, st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+    hoistExpression(ssa, loop, st->whileSt.condition);
+    hoistStatement(ssa, loop, st->whileSt.body);
+    break;
+  case ST_FOR:
+    hoistLValue(ssa, loop, st->forSt.variable);
+    hoistExpression(ssa, loop, st->forSt.from);
+    hoistExpression(ssa, loop, st->forSt.to);
+    hoistStatement(ssa, loop, st->forSt.body);
+    break;
+  }
+}
+
+void moveInvariants(SSA* ssa, Statement* st);
+
+// Computes before st, a loop, what does not change in it, then does the
+// same for the loops inside. The loop becomes a group that starts with
+// the assignments to the temporaries.
+void moveLoopInvariants(SSA* ssa, Statement* st) {
+  Statement* copy;
+  Statement* body;
+  Loop loop;
+
+  memset(&loop, 0, sizeof(Loop));
+  ssa->generation ++;
+  ssa->assignedCount = 0;
+  if (st->kind == ST_WHILE) {
+    scanExpression(ssa, &loop, st->whileSt.condition);
+    scanStatement(ssa, &loop, st->whileSt.body);
+    hoistExpression(ssa, &loop, st->whileSt.condition);
+    hoistStatement(ssa, &loop, st->whileSt.body);
+    body = st->whileSt.body;
+  } else {
+    scanStore(ssa, &loop, st->forSt.variable);
+    scanStatement(ssa, &loop, st->forSt.body);
+    hoistStatement(ssa, &loop, st->forSt.body);
+    body = st->forSt.body;
+  }
+
+  if (loop.first != NULL) {
+    copy = (Statement*) arenaAlloc(compileArena, sizeof(Statement));
+    *copy = *st;
+    copy->next = NULL;
+    loop.last->next = copy;
+    st->kind = ST_GROUP;
+    st->body = loop.first;
+  }
+  moveInvariants(ssa, body);
+}
+
+void moveInvariants(SSA* ssa, Statement* st) {
+  Statement* s;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      moveInvariants(ssa, s);
+    break;
+  case ST_IF:
+    moveInvariants(ssa, st->ifSt.thenPart);
+    moveInvariants(ssa, st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+  case ST_FOR:
+    moveLoopInvariants(ssa, st);
+    break;
+  default:
+    break;
+  }
+}
+
+/******************* Copies and common subexpressions ******************************/
+
+Value* rootOf(SSA* ssa, Value* v);
+
+// The value v is a copy of, if any: the slot an assignment reads, or the
+// value both branches of an IF leave
+Value* copySource(SSA* ssa, Value* v) {
+  Value* left;
+
+  if ((v->kind == VAL_DEF) && (v->exp->kind == EXP_VARIABLE) &&
+      (slotOf(ssa, v->exp->lvalue->object) >= 0))
+    return useOf(ssa, v->exp);
+  if (v->kind == VAL_JOIN) {
+    left = rootOf(ssa, v->operands[0]);
+    if (left == rootOf(ssa, v->operands[1]))
+      return left;
+  }
+  return NULL;
+}
+
+Value* rootOf(SSA* ssa, Value* v) {
+  Value* source;
+
+  if (v->root == NULL) {
+    source = copySource(ssa, v);
+    v->root = (source == NULL) ? v : rootOf(ssa, source);
+  }
+  return v->root;
+}
+
+// Reads, instead of a copy, the slot it was copied from if that slot
+// still holds the same value here. The copy may then be dead.
+void propagateCopy(SSA* ssa, Expression* exp, Value** defs) {
+  Value* v = useOf(ssa, exp);
+  Value* best = v;
+  Value* source;
+
+  if (v == NULL) return;
+  while ((source = copySource(ssa, v)) != NULL) {
+    if (defs[source->slot] == source)
+      best = source;
+    v = source;
+  }
+  if (best != useOf(ssa, exp)) {
+    exp->lvalue = makeLValue(ssa->slots[best->slot], NULL, exp->lvalue->type);
+    mapPut(&ssa->map, exp, best);
+  }
+}
+
+// The instructions an expression that isNumbered compiles to
+int expressionCost(Expression* exp) {
+  int cost;
+
+  switch (exp->kind) {
+  case EXP_NEGATE:
+    return expressionCost(exp->operand) + 1;
+  case EXP_BINARY:
+    for (cost = 0; exp->kind == EXP_BINARY; exp = exp->binary.left)
+      cost += expressionCost(exp->binary.right) + 1;
+    return cost + expressionCost(exp);
+  default:
+    return 1;
+  }
+}
+
+int addressCost(LValue* lvalue) {
+  Expression* index;
+  int cost = 1;
+
+  for (index = lvalue->indexes; index != NULL; index = index->next)
+    cost += expressionCost(index) + 3;
+  return cost;
+}
+
+Available* findAvailable(SSA* ssa, int number) {
+  if (number < ssa->availableCapacity)
+    return ssa->available[number];
+  return NULL;
+}
+
+Available* addAvailable(SSA* ssa, int number) {
+  Available* a = (Available*) arenaAlloc(compileArena, sizeof(Available));
+  int capacity;
+
+  if (number >= ssa->availableCapacity) {
+    capacity = ssa->availableCapacity;
+    ssa->availableCapacity = 2 * number + 16;
+    ssa->available = (Available**) realloc(ssa->available, ssa->availableCapacity * sizeof(Available*));
+    while (capacity < ssa->availableCapacity)
+      ssa->available[capacity ++] = NULL;
+  }
+  if (ssa->undoCount == ssa->undoCapacity) {
+    ssa->undoCapacity = 2 * ssa->undoCapacity + 16;
+    ssa->undo = (int*) realloc(ssa->undo, ssa->undoCapacity * sizeof(int));
+  }
+  ssa->undo[ssa->undoCount ++] = number;
+  ssa->available[number] = a;
+  a->exp = NULL;
+  a->lvalue = NULL;
+  a->temp = NULL;
+  return a;
+}
+
+// Forgets what became available since mark, on leaving a branch or a
+// loop body that does not run on every path
+void leaveScope(SSA* ssa, int mark) {
+  while (ssa->undoCount > mark)
+    ssa->available[ssa->undo[-- ssa->undoCount]] = NULL;
+}
+
+// The first occurrence starts keeping its value in a temporary. It is
+// rewritten in place, so it is still computed exactly where it was.
+void keepAvailable(SSA* ssa, Available* a) {
+  Expression* copy;
+  LValue* lvalue;
+
+  a->temp = createTemporaryObject(ssa->scope, intType);
+  if (a->exp != NULL) {
+    copy = (Expression*) arenaAlloc(compileArena, sizeof(Expression));
+    *copy = *a->exp;
+    copy->next = NULL;
+    a->exp->kind = EXP_SAVE;
+    a->exp->save.temp = a->temp;
+    a->exp->save.operand = copy;
+  } else {
+    lvalue = makeLValue(a->lvalue->object, a->lvalue->indexes, a->lvalue->type);
+    a->lvalue->object = NULL;
+    a->lvalue->indexes = NULL;
+    a->lvalue->address = makeSaveExpression(a->temp, makeReferenceExpression(lvalue));
+  }
+}
+
+void cseExpression(SSA* ssa, Expression* exp);
+void cseStatement(SSA* ssa, Statement* st);
+
+void cseLValue(SSA* ssa, LValue* lvalue) {
+  Expression* index;
+  Available* a;
+  int number;
+
+  if (lvalue->object == NULL) {
+    cseExpression(ssa, lvalue->address);
+    return;
+  }
+  if (isNumberedAddress(ssa, lvalue) && (addressCost(lvalue) >= CSE_MINIMUM_COST)) {
+    number = numberAddress(ssa, lvalue);
+    a = findAvailable(ssa, number);
+    if (a != NULL) {
+      if (a->temp == NULL)
+	keepAvailable(ssa, a);
+      lvalue->object = NULL;
+      lvalue->indexes = NULL;
+      lvalue->address = readTemp(a->temp);
+      return;
+    }
+    addAvailable(ssa, number)->lvalue = lvalue;
+  }
+  for (index = lvalue->indexes; index != NULL; index = index->next)
+    cseExpression(ssa, index);
+}
+
+// Takes exp from the temporary of an equal expression computed before,
+// if there is one; otherwise it becomes available. Returns whether it was
+// replaced.
+int reuseExpression(SSA* ssa, Expression* exp, int number) {
+  Available* a = findAvailable(ssa, number);
+
+  if (a != NULL) {
+    if (a->temp == NULL)
+      keepAvailable(ssa, a);
+    exp->kind = EXP_VARIABLE;
+    exp->lvalue = makeLValue(a->temp, NULL, exp->type);
+    return 1;
+  }
+  addAvailable(ssa, number)->exp = exp;
+  return 0;
+}
+
+// The numbers and costs of a chain are found once, from the first operand
+// up while it is numbered. Its nodes are then visited from the top down
+// until one is replaced, and the right operands above it from the lowest
+// up, as the chain is evaluated.
+void cseChain(SSA* ssa, Expression* exp) {
+  Chain chain;
+  Expression* node;
+  int* numbers;                 // of chain.nodes[i], for i >= numbered
+  int* costs;
+  int numbered, number, cost, i;
+
+  openChain(&chain, exp);
+  numbers = (int*) malloc(2 * chain.count * sizeof(int));
+  costs = numbers + chain.count;
+  numbered = chain.count;
+  node = chain.nodes[chain.count - 1]->binary.left;
+  if (isNumbered(ssa, node)) {
+    number = numberExpression(ssa, node);
+    cost = expressionCost(node);
+    for (i = chain.count - 1; i >= 0; i --) {
+      node = chain.nodes[i];
+      if (!isNumbered(ssa, node->binary.right))
+	break;
+      number = numberOperation(ssa, node->binary.op, number, numberExpression(ssa, node->binary.right));
+      cost += expressionCost(node->binary.right) + 1;
+      numbers[i] = number;
+      costs[i] = cost;
+      numbered = i;
+    }
+  }
+
+  for (i = 0; i < chain.count; i ++)
+    if ((i >= numbered) && (costs[i] >= CSE_MINIMUM_COST) &&
+	reuseExpression(ssa, chain.nodes[i], numbers[i]))
+      break;
+  if (i == chain.count)
+    cseExpression(ssa, chain.nodes[i - 1]->binary.left);
+  for (i --; i >= 0; i --)
+    cseExpression(ssa, chain.nodes[i]->binary.right);
+  free(numbers);
+  closeChain(&chain);
+}
+
+// Walks expressions in the order they are evaluated
+void cseExpression(SSA* ssa, Expression* exp) {
+  Expression* arg;
+
+  if (exp->kind == EXP_CONSTANT)
+    return;
+  if (exp->kind == EXP_BINARY) {
+    cseChain(ssa, exp);
+    return;
+  }
+  if (isNumbered(ssa, exp) && (expressionCost(exp) >= CSE_MINIMUM_COST) &&
+      reuseExpression(ssa, exp, numberExpression(ssa, exp)))
+    return;
+
+  switch (exp->kind) {
+  case EXP_VARIABLE:
+  case EXP_REFERENCE:
+    cseLValue(ssa, exp->lvalue);
+    break;
+  case EXP_CALL:
+    for (arg = exp->call.arguments; arg != NULL; arg = arg->next)
+      cseExpression(ssa, arg);
+    break;
+  case EXP_NEGATE:
+    cseExpression(ssa, exp->operand);
+    break;
+  case EXP_SAVE:
+    cseExpression(ssa, exp->save.operand);
+    break;
+  case EXP_INLINE:
+    cseStatement(ssa, exp->inlined.body);
+    cseExpression(ssa, exp->inlined.value);
+    break;
+  default:
+    break;
+  }
+}
+
+// What is computed in a statement is available after it, and in what it
+// runs on every path after that: a condition dominates its branches, and
+// a loop's test, run each time round, dominates its body and what follows
+// the loop.
+void cseStatement(SSA* ssa, Statement* st) {
+  Expression* arg;
+  Statement* s;
+  int mark;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    cseLValue(ssa, st->assign.lvalue);
+    cseExpression(ssa, st->assign.value);
+    break;
+  case ST_CALL:
+    for (arg = st->call.arguments; arg != NULL; arg = arg->next)
+      cseExpression(ssa, arg);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      cseStatement(ssa, s);
+    break;
+  case ST_IF:
+    cseExpression(ssa, st->ifSt.condition);
+    mark = ssa->undoCount;
+    cseStatement(ssa, st->ifSt.thenPart);
+    leaveScope(ssa, mark);
+    cseStatement(ssa, st->ifSt.elsePart);
+    leaveScope(ssa, mark);
+    break;
+  case ST_WHILE:
+    cseExpression(ssa, st->whileSt.condition);
+    mark = ssa->undoCount;
+    cseStatement(ssa, st->whileSt.body);
+    leaveScope(ssa, mark);
+    break;
+  case ST_FOR:
+    cseLValue(ssa, st->forSt.variable);
+    cseExpression(ssa, st->forSt.from);
+    cseExpression(ssa, st->forSt.to);
+    mark = ssa->undoCount;
+    cseStatement(ssa, st->forSt.body);
+    leaveScope(ssa, mark);
+    break;
+  }
+}
+
+/******************* Dead assignments ******************************/
+
+struct LiveStack_ {
+  Value** values;
+  int count;
+  int capacity;
+};
+
+typedef struct LiveStack_ LiveStack;
+
+void pushLive(LiveStack* stack, Value* v) {
+  if ((v == NULL) || v->live)
+    return;
+  if (stack->count == stack->capacity) {
+    stack->capacity = 2 * stack->capacity + 64;
+    stack->values = (Value**) realloc(stack->values, stack->capacity * sizeof(Value*));
+  }
+  v->live = 1;
+  stack->values[stack->count ++] = v;
+}
+
+// Marks live the values the essential reads need, then those they need
+void markLive(SSA* ssa) {
+  LiveStack stack;
+  Use* use;
+  Value* v;
+
+  stack.values = NULL;
+  stack.count = stack.capacity = 0;
+  for (use = ssa->essential; use != NULL; use = use->next)
+    pushLive(&stack, use->value);
+  while (stack.count > 0) {
+    v = stack.values[-- stack.count];
+    for (use = v->owned; use != NULL; use = use->next)
+      pushLive(&stack, use->value);
+    pushLive(&stack, v->operands[0]);
+    pushLive(&stack, v->operands[1]);
+  }
+  free(stack.values);
+}
+
+void removeDead(SSA* ssa, Statement* st);
+
+// Inlined function calls have assignments of their own
+void removeDeadIn(SSA* ssa, Expression* exp) {
+  Expression* operand;
+
+  for (; exp != NULL; exp = exp->next)
+    switch (exp->kind) {
+    case EXP_VARIABLE:
+    case EXP_REFERENCE:
+      if (exp->lvalue->object == NULL)
+	removeDeadIn(ssa, exp->lvalue->address);
+      else removeDeadIn(ssa, exp->lvalue->indexes);
+      break;
+    case EXP_CALL:
+      removeDeadIn(ssa, exp->call.arguments);
+      break;
+    case EXP_NEGATE:
+      removeDeadIn(ssa, exp->operand);
+      break;
+    case EXP_BINARY:
+      for (operand = exp; operand->kind == EXP_BINARY; operand = operand->binary.left)
+	removeDeadIn(ssa, operand->binary.right);
+      removeDeadIn(ssa, operand);
+      break;
+    case EXP_SAVE:
+      removeDeadIn(ssa, exp->save.operand);
+      break;
+    case EXP_INLINE:
+      removeDead(ssa, exp->inlined.body);
+      removeDeadIn(ssa, exp->inlined.value);
+      break;
+    default:
+      break;
+    }
+}
+
+void removeDead(SSA* ssa, Statement* st) {
+  Statement* s;
+  Value* v;
+
+  if (st == NULL) return;
+  switch (st->kind) {
+  case ST_ASSIGN:
+    if (slotOf(ssa, st->assign.lvalue->object) >= 0) {
+      v = (Value*) mapGet(&ssa->map, st);
+      if (!v->live && v->removable) {
+	replaceStatement(st, NULL);
+	break;
+      }
+    }
+    removeDeadIn(ssa, st->assign.value);
+    break;
+  case ST_CALL:
+    removeDeadIn(ssa, st->call.arguments);
+    break;
+  case ST_GROUP:
+    for (s = st->body; s != NULL; s = s->next)
+      removeDead(ssa, s);
+    break;
+  case ST_IF:
+    removeDeadIn(ssa, st->ifSt.condition);
+    removeDead(ssa, st->ifSt.thenPart);
+    removeDead(ssa, st->ifSt.elsePart);
+    break;
+  case ST_WHILE:
+    removeDeadIn(ssa, st->whileSt.condition);
+    removeDead(ssa, st->whileSt.body);
+    break;
+  case ST_FOR:
+    removeDeadIn(ssa, st->forSt.from);
+    removeDeadIn(ssa, st->forSt.to);
+    removeDead(ssa, st->forSt.body);
+    break;
+  }
+}
+
+/******************* Driver ******************************/
+
+void optimizeBlock(Block* block) {
+  SSA ssa;
+  Statement* s;
+
+  memset(&ssa, 0, sizeof(SSA));
+  findSlots(&ssa, block);
+  ssa.entries = (Value**) malloc((ssa.slotCount + 1) * sizeof(Value*));
+  ssa.marks = (int*) calloc(ssa.slotCount + 1, sizeof(int));
+  ssa.assigned = (int*) malloc((ssa.slotCount + 1) * sizeof(int));
+  initMap(&ssa.map);
+  initMap(&ssa.objectNumbers);
+
+  // Constants
+  buildSSA(&ssa, block);
+  ssa.budget = SCCP_BUDGET;
+  for (s = block->body; s != NULL; s = s->next)
+    evalStatement(&ssa, s);
+  if (!ssa.failed)
+    for (s = block->body; s != NULL; s = s->next)
+      foldStatement(&ssa, s);
+
+  // Loop invariants
+  for (s = block->body; s != NULL; s = s->next)
+    moveInvariants(&ssa, s);
+
+  // Copies and common subexpressions
+  buildSSA(&ssa, block);
+  replaySSA(&ssa, block);
+  for (s = block->body; s != NULL; s = s->next)
+    cseStatement(&ssa, s);
+
+  // Dead assignments
+  buildSSA(&ssa, block);
+  markLive(&ssa);
+  for (s = block->body; s != NULL; s = s->next)
+    removeDead(&ssa, s);
+
+  freeMap(&ssa.map);
+  freeMap(&ssa.objectNumbers);
+  free(ssa.numbers);
+  free(ssa.available);
+  free(ssa.undo);
+  free(ssa.entries);
+  free(ssa.marks);
+  free(ssa.assigned);
+  free(ssa.slots);
+  free(ssa.slotOfOffset);
+}
+
+void optimizeSSA(Block* block) {
+  Block* subBlock;
+
+  optimizeBlock(block);
+  for (subBlock = block->subBlocks; subBlock != NULL; subBlock = subBlock->next)
+    optimizeSSA(subBlock);
+}
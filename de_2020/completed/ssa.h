@@ -0,0 +1,11 @@
+/* SSA optimizer */
+
+#ifndef __SSA_H__
+#define __SSA_H__
+
+#include "ast.h"
+
+// Optimizes block and every subprogram declared in it
+void optimizeSSA(Block* block);
+
+#endif
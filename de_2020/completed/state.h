@@ -0,0 +1,17 @@
+/* Compiler state kept per compilation */
+
+#ifndef __STATE_H__
+#define __STATE_H__
+
+// Every variable that belongs to one compilation is declared (and declared
+// extern) as COMPILER_STATE. Each thread has its own copy, so threads can
+// compile separate programs at the same time. Tables that never change
+// after start-up (keywords, charCodes, the scanner automaton) are shared.
+
+#if defined(__GNUC__) && !defined(_WIN32)
+  #define COMPILER_STATE __thread
+#else
+  #define COMPILER_STATE
+#endif
+
+#endif
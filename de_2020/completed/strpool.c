@@ -0,0 +1,119 @@
+/* String pool: one copy of each identifier and string */
+
+#include <stdlib.h>
+#include <string.h>
+#include "state.h"
+#include "charcode.h"
+#include "arena.h"
+#include "strpool.h"
+
+#define INITIAL_BUCKET_COUNT 256
+
+struct StringNode_ {
+  unsigned int hash;
+  int length;
+  struct StringNode_ *next;
+  char* string;                 // points just past the node, same allocation
+};
+
+typedef struct StringNode_ StringNode;
+
+extern COMPILER_STATE Arena* compileArena;
+
+COMPILER_STATE StringNode** buckets = NULL;
+COMPILER_STATE int bucketCount = 0;
+COMPILER_STATE int stringCount = 0;
+
+unsigned int hashLexeme(char* lexeme, int length, int foldCase) {
+  unsigned int hash = 2166136261u;  // FNV-1a
+  int i;
+  for (i = 0; i < length; i ++) {
+    hash ^= foldCase ? (unsigned char) TO_UPPER(lexeme[i]) : (unsigned char) lexeme[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+int sameLexeme(char* string, char* lexeme, int length, int foldCase) {
+  int i;
+  if (!foldCase)
+    return (memcmp(string, lexeme, length) == 0);
+  for (i = 0; i < length; i ++)
+    if (string[i] != TO_UPPER(lexeme[i])) return 0;
+  return 1;
+}
+
+void growStringPool(void) {
+  int newCount = bucketCount * 2;
+  StringNode** newBuckets = (StringNode**) calloc(newCount, sizeof(StringNode*));
+  int i;
+
+  for (i = 0; i < bucketCount; i ++) {
+    StringNode* node = buckets[i];
+    while (node != NULL) {
+      StringNode* next = node->next;
+      int slot = node->hash & (newCount - 1);
+      node->next = newBuckets[slot];
+      newBuckets[slot] = node;
+      node = next;
+    }
+  }
+  free(buckets);
+  buckets = newBuckets;
+  bucketCount = newCount;
+}
+
+void initStringPool(void) {
+  bucketCount = INITIAL_BUCKET_COUNT;
+  buckets = (StringNode**) calloc(bucketCount, sizeof(StringNode*));
+  stringCount = 0;
+}
+
+// The strings themselves live in the compilation arena
+void cleanStringPool(void) {
+  free(buckets);
+  buckets = NULL;
+  bucketCount = 0;
+  stringCount = 0;
+}
+
+char* intern(char* lexeme, int length, int foldCase) {
+  unsigned int hash = hashLexeme(lexeme, length, foldCase);
+  int i;
+  StringNode* node = buckets[hash & (bucketCount - 1)];
+
+  while (node != NULL) {
+    if ((node->hash == hash) && (node->length == length) && 
+	sameLexeme(node->string, lexeme, length, foldCase))
+      return node->string;
+    node = node->next;
+  }
+
+  if (stringCount >= bucketCount * 2)
+    growStringPool();
+
+  node = (StringNode*) arenaAlloc(compileArena, sizeof(StringNode) + length + 1);
+  node->hash = hash;
+  node->length = length;
+  node->string = (char*) (node + 1);
+  for (i = 0; i < length; i ++)
+    node->string[i] = foldCase ? TO_UPPER(lexeme[i]) : lexeme[i];
+  node->string[length] = '\0';
+
+  node->next = buckets[hash & (bucketCount - 1)];
+  buckets[hash & (bucketCount - 1)] = node;
+  stringCount ++;
+  return node->string;
+}
+
+char* internLexeme(char* lexeme, int length) {
+  return intern(lexeme, length, 0);
+}
+
+char* internIdentifier(char* lexeme, int length) {
+  return intern(lexeme, length, 1);
+}
+
+char* internString(char* string) {
+  return internLexeme(string, strlen(string));
+}
@@ -0,0 +1,17 @@
+/* String pool: one copy of each identifier and string */
+
+#ifndef __STRPOOL_H__
+#define __STRPOOL_H__
+
+// Every lexeme is interned exactly once, so two equal strings returned by
+// the pool are the same pointer and can be compared with ==.
+// internIdentifier folds the lexeme to upper case on the way in.
+
+void initStringPool(void);
+void cleanStringPool(void);
+
+char* internString(char* string);
+char* internLexeme(char* lexeme, int length);
+char* internIdentifier(char* lexeme, int length);
+
+#endif
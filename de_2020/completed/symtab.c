@@ -6,79 +6,92 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#include "state.h"
 #include "symtab.h"
+#include "arena.h"
+#include "strpool.h"
 #include "error.h"
 #include "codegen.h"
 
-void freeObject(Object* obj);
-void freeScope(Scope* scope);
-void freeObjectList(ObjectNode *objList);
-void freeReferenceList(ObjectNode *objList);
+// Everything in the symbol table comes from the compilation arena and is
+// released with it at the end of compile()
+extern COMPILER_STATE Arena* compileArena;
 
-SymTab* symtab;
-Type* intType;
-Type* charType;
-Object* writeiProcedure;
-Object* writecProcedure;
-Object* writelnProcedure;
-Object* readiFunction;
-Object* readcFunction;
+COMPILER_STATE SymTab* symtab;
+COMPILER_STATE Type* intType;
+COMPILER_STATE Type* charType;
+COMPILER_STATE Object* writeiProcedure;
+COMPILER_STATE Object* writecProcedure;
+COMPILER_STATE Object* writelnProcedure;
+COMPILER_STATE Object* readiFunction;
+COMPILER_STATE Object* readcFunction;
 
 /******************* Type utilities ******************************/
 
-Type* makeIntType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_INT;
+// Types are hash-consed: structurally equal types are the same object, so
+// they are never copied or freed and equality is a pointer comparison.
+
+#define ARRAY_TYPE_BUCKETS 256
+
+struct ArrayTypeNode_ {
+  Type* type;
+  struct ArrayTypeNode_ *next;
+};
+
+typedef struct ArrayTypeNode_ ArrayTypeNode;
+
+COMPILER_STATE ArrayTypeNode** arrayTypes;
+
+Type* makeBasicType(enum TypeClass typeClass) {
+  Type* type = (Type*) arenaAlloc(compileArena, sizeof(Type));
+  type->typeClass = typeClass;
+  type->arraySize = 0;
+  type->elementType = NULL;
   return type;
 }
 
+void initTypes(void) {
+  int i;
+
+  arrayTypes = (ArrayTypeNode**) arenaAlloc(compileArena, ARRAY_TYPE_BUCKETS * sizeof(ArrayTypeNode*));
+  for (i = 0; i < ARRAY_TYPE_BUCKETS; i ++)
+    arrayTypes[i] = NULL;
+  intType = makeBasicType(TP_INT);
+  charType = makeBasicType(TP_CHAR);
+}
+
+Type* makeIntType(void) {
+  return intType;
+}
+
 Type* makeCharType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_CHAR;
-  return type;
+  return charType;
 }
 
 Type* makeArrayType(int arraySize, Type* elementType) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_ARRAY;
+  unsigned int slot = ((unsigned int) arraySize * 31u + (unsigned int) (((size_t) elementType) >> 3)) % ARRAY_TYPE_BUCKETS;
+  ArrayTypeNode* node = arrayTypes[slot];
+  Type* type;
+
+  while (node != NULL) {
+    if ((node->type->arraySize == arraySize) && (node->type->elementType == elementType))
+      return node->type;
+    node = node->next;
+  }
+
+  type = makeBasicType(TP_ARRAY);
   type->arraySize = arraySize;
   type->elementType = elementType;
-  return type;
-}
 
-Type* duplicateType(Type* type) {
-  Type* resultType = (Type*) malloc(sizeof(Type));
-  resultType->typeClass = type->typeClass;
-  if (type->typeClass == TP_ARRAY) {
-    resultType->arraySize = type->arraySize;
-    resultType->elementType = duplicateType(type->elementType);
-  }
-  return resultType;
+  node = (ArrayTypeNode*) arenaAlloc(compileArena, sizeof(ArrayTypeNode));
+  node->type = type;
+  node->next = arrayTypes[slot];
+  arrayTypes[slot] = node;
+  return type;
 }
 
 int compareType(Type* type1, Type* type2) {
-  if (type1->typeClass == type2->typeClass) {
-    if (type1->typeClass == TP_ARRAY) {
-      if (type1->arraySize == type2->arraySize)
-	return compareType(type1->elementType, type2->elementType);
-      else return 0;
-    } else return 1;
-  } else return 0;
-}
-
-void freeType(Type* type) {
-  switch (type->typeClass) {
-  case TP_INT:
-  case TP_CHAR:
-    free(type);
-    break;
-  case TP_ARRAY:
-    freeType(type->elementType);
-    freeType(type);
-    break;
-  }
+  return (type1 == type2);
 }
 
 int sizeOfType(Type* type) {
@@ -96,21 +109,21 @@ int sizeOfType(Type* type) {
 /******************* Constant utility ******************************/
 
 ConstantValue* makeIntConstant(int i) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = (ConstantValue*) arenaAlloc(compileArena, sizeof(ConstantValue));
   value->type = TP_INT;
   value->intValue = i;
   return value;
 }
 
 ConstantValue* makeCharConstant(char ch) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = (ConstantValue*) arenaAlloc(compileArena, sizeof(ConstantValue));
   value->type = TP_CHAR;
   value->charValue = ch;
   return value;
 }
 
 ConstantValue* duplicateConstantValue(ConstantValue* v) {
-  ConstantValue* value = (ConstantValue*) malloc(sizeof(ConstantValue));
+  ConstantValue* value = (ConstantValue*) arenaAlloc(compileArena, sizeof(ConstantValue));
   value->type = v->type;
   if (v->type == TP_INT) 
     value->intValue = v->intValue;
@@ -122,7 +135,7 @@ ConstantValue* duplicateConstantValue(ConstantValue* v) {
 /******************* Object utilities ******************************/
 
 Scope* createScope(Object* owner) {
-  Scope* scope = (Scope*) malloc(sizeof(Scope));
+  Scope* scope = (Scope*) arenaAlloc(compileArena, sizeof(Scope));
   scope->objList = NULL;
   scope->owner = owner;
   scope->outer = NULL;
@@ -131,145 +144,89 @@ Scope* createScope(Object* owner) {
 }
 
 Object* createProgramObject(char *programName) {
-  Object* program = (Object*) malloc(sizeof(Object));
-  strcpy(program->name, programName);
+  Object* program = (Object*) arenaAlloc(compileArena, sizeof(Object));
+  program->name = internString(programName);
   program->kind = OBJ_PROGRAM;
-  program->progAttrs = (ProgramAttributes*) malloc(sizeof(ProgramAttributes));
-  program->progAttrs->scope = createScope(program);
-  program->progAttrs->codeAddress = DC_VALUE;
+  program->progAttrs.scope = createScope(program);
+  program->progAttrs.codeAddress = DC_VALUE;
   symtab->program = program;
 
   return program;
 }
 
 Object* createConstantObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = (Object*) arenaAlloc(compileArena, sizeof(Object));
+  obj->name = internString(name);
   obj->kind = OBJ_CONSTANT;
-  obj->constAttrs = (ConstantAttributes*) malloc(sizeof(ConstantAttributes));
   return obj;
 }
 
 Object* createTypeObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = (Object*) arenaAlloc(compileArena, sizeof(Object));
+  obj->name = internString(name);
   obj->kind = OBJ_TYPE;
-  obj->typeAttrs = (TypeAttributes*) malloc(sizeof(TypeAttributes));
   return obj;
 }
 
 Object* createVariableObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = (Object*) arenaAlloc(compileArena, sizeof(Object));
+  obj->name = internString(name);
   obj->kind = OBJ_VARIABLE;
-  obj->varAttrs = (VariableAttributes*) malloc(sizeof(VariableAttributes));
-  obj->varAttrs->type = NULL;
-  obj->varAttrs->scope = NULL;
-  obj->varAttrs->localOffset = 0;
+  obj->varAttrs.type = NULL;
+  obj->varAttrs.scope = NULL;
+  obj->varAttrs.localOffset = 0;
   return obj;
 }
 
 Object* createFunctionObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = (Object*) arenaAlloc(compileArena, sizeof(Object));
+  obj->name = internString(name);
   obj->kind = OBJ_FUNCTION;
-  obj->funcAttrs = (FunctionAttributes*) malloc(sizeof(FunctionAttributes));
-  obj->funcAttrs->returnType = NULL;
-  obj->funcAttrs->paramList = NULL;
-  obj->funcAttrs->paramCount = 0;
-  obj->funcAttrs->codeAddress = DC_VALUE;
-  obj->funcAttrs->scope = createScope(obj);
+  obj->funcAttrs.returnType = NULL;
+  obj->funcAttrs.paramList = NULL;
+  obj->funcAttrs.paramCount = 0;
+  obj->funcAttrs.codeAddress = DC_VALUE;
+  obj->funcAttrs.scope = createScope(obj);
   return obj;
 }
 
 Object* createProcedureObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = (Object*) arenaAlloc(compileArena, sizeof(Object));
+  obj->name = internString(name);
   obj->kind = OBJ_PROCEDURE;
-  obj->procAttrs = (ProcedureAttributes*) malloc(sizeof(ProcedureAttributes));
-  obj->procAttrs->paramList = NULL;
-  obj->procAttrs->paramCount = 0;
-  obj->procAttrs->codeAddress = DC_VALUE;
-  obj->procAttrs->scope = createScope(obj);
+  obj->procAttrs.paramList = NULL;
+  obj->procAttrs.paramCount = 0;
+  obj->procAttrs.codeAddress = DC_VALUE;
+  obj->procAttrs.scope = createScope(obj);
   return obj;
 }
 
 Object* createParameterObject(char *name, enum ParamKind kind) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
+  Object* obj = (Object*) arenaAlloc(compileArena, sizeof(Object));
+  obj->name = internString(name);
   obj->kind = OBJ_PARAMETER;
-  obj->paramAttrs = (ParameterAttributes*) malloc(sizeof(ParameterAttributes));
-  obj->paramAttrs->kind = kind;
-  obj->paramAttrs->type = NULL;
-  obj->paramAttrs->scope = NULL;
-  obj->paramAttrs->localOffset = 0;
+  obj->paramAttrs.kind = kind;
+  obj->paramAttrs.type = NULL;
+  obj->paramAttrs.scope = NULL;
+  obj->paramAttrs.localOffset = 0;
   return obj;
 }
 
-void freeObject(Object* obj) {
-  switch (obj->kind) {
-  case OBJ_CONSTANT:
-    free(obj->constAttrs->value);
-    free(obj->constAttrs);
-    break;
-  case OBJ_TYPE:
-    free(obj->typeAttrs->actualType);
-    free(obj->typeAttrs);
-    break;
-  case OBJ_VARIABLE:
-    free(obj->varAttrs->type);
-    free(obj->varAttrs);
-    break;
-  case OBJ_FUNCTION:
-    freeReferenceList(obj->funcAttrs->paramList);
-    freeType(obj->funcAttrs->returnType);
-    freeScope(obj->funcAttrs->scope);
-    free(obj->funcAttrs);
-    break;
-  case OBJ_PROCEDURE:
-    freeReferenceList(obj->procAttrs->paramList);
-    freeScope(obj->procAttrs->scope);
-    free(obj->procAttrs);
-    break;
-  case OBJ_PROGRAM:
-    freeScope(obj->progAttrs->scope);
-    free(obj->progAttrs);
-    break;
-  case OBJ_PARAMETER:
-    freeType(obj->paramAttrs->type);
-    free(obj->paramAttrs);
-  }
-  free(obj);
-}
-
-void freeScope(Scope* scope) {
-  freeObjectList(scope->objList);
-  free(scope);
-}
-
-void freeObjectList(ObjectNode *objList) {
-  ObjectNode* list = objList;
-
-  while (list != NULL) {
-    ObjectNode* node = list;
-    list = list->next;
-    freeObject(node->object);
-    free(node);
-  }
-}
-
-void freeReferenceList(ObjectNode *objList) {
-  ObjectNode* list = objList;
-
-  while (list != NULL) {
-    ObjectNode* node = list;
-    list = list->next;
-    free(node);
-  }
+// A variable the compiler keeps values of its own in. No name refers to
+// it; it takes the next free words of scope's frame and is listed there
+// like the variables declared.
+Object* createTemporaryObject(Scope* scope, Type* type) {
+  Object* obj = createVariableObject("");
+  obj->varAttrs.type = type;
+  obj->varAttrs.scope = scope;
+  obj->varAttrs.localOffset = scope->frameSize;
+  scope->frameSize += sizeOfType(type);
+  addObject(&(scope->objList), obj);
+  return obj;
 }
 
 void addObject(ObjectNode **objList, Object* obj) {
-  ObjectNode* node = (ObjectNode*) malloc(sizeof(ObjectNode));
+  ObjectNode* node = (ObjectNode*) arenaAlloc(compileArena, sizeof(ObjectNode));
   node->object = obj;
   node->next = NULL;
   if ((*objList) == NULL) 
@@ -282,9 +239,10 @@ void addObject(ObjectNode **objList, Object* obj) {
   }
 }
 
+// name must come from the string pool
 Object* findObject(ObjectNode *objList, char *name) {
   while (objList != NULL) {
-    if (strcmp(objList->object->name, name) == 0) 
+    if (objList->object->name == name) 
       return objList->object;
     else objList = objList->next;
   }
@@ -296,48 +254,46 @@ Object* findObject(ObjectNode *objList, char *name) {
 void initSymTab(void) {
   Object* param;
 
-  symtab = (SymTab*) malloc(sizeof(SymTab));
+  symtab = (SymTab*) arenaAlloc(compileArena, sizeof(SymTab));
   symtab->globalObjectList = NULL;
   symtab->program = NULL;
   symtab->currentScope = NULL;
+
+  initTypes();
   
   readcFunction = createFunctionObject("READC");
   declareObject(readcFunction);
-  readcFunction->funcAttrs->returnType = makeCharType();
+  readcFunction->funcAttrs.returnType = makeCharType();
 
   readiFunction = createFunctionObject("READI");
   declareObject(readiFunction);
-  readiFunction->funcAttrs->returnType = makeIntType();
+  readiFunction->funcAttrs.returnType = makeIntType();
 
   writeiProcedure = createProcedureObject("WRITEI");
   declareObject(writeiProcedure);
-  enterBlock(writeiProcedure->procAttrs->scope);
+  enterBlock(writeiProcedure->procAttrs.scope);
     param = createParameterObject("i", PARAM_VALUE);
-    param->paramAttrs->type = makeIntType();
+    param->paramAttrs.type = makeIntType();
     declareObject(param);
   exitBlock();
 
   writecProcedure = createProcedureObject("WRITEC");
   declareObject(writecProcedure);
-  enterBlock(writecProcedure->procAttrs->scope);
+  enterBlock(writecProcedure->procAttrs.scope);
     param = createParameterObject("ch", PARAM_VALUE);
-    param->paramAttrs->type = makeCharType();
+    param->paramAttrs.type = makeCharType();
     declareObject(param);
   exitBlock();
 
   writelnProcedure = createProcedureObject("WRITELN");
   declareObject(writelnProcedure);
-
-  intType = makeIntType();
-  charType = makeCharType();
 }
 
 void cleanSymTab(void) {
-  freeObject(symtab->program);
-  freeObjectList(symtab->globalObjectList);
-  free(symtab);
-  freeType(intType);
-  freeType(charType);
+  symtab = NULL;
+  intType = NULL;
+  charType = NULL;
+  arrayTypes = NULL;
 }
 
 void enterBlock(Scope* scope) {
@@ -356,33 +312,33 @@ void declareObject(Object* obj) {
   else {
     switch (obj->kind) {
     case OBJ_VARIABLE:
-      obj->varAttrs->scope = symtab->currentScope;
-      obj->varAttrs->localOffset = symtab->currentScope->frameSize;
-      symtab->currentScope->frameSize += sizeOfType(obj->varAttrs->type);
+      obj->varAttrs.scope = symtab->currentScope;
+      obj->varAttrs.localOffset = symtab->currentScope->frameSize;
+      symtab->currentScope->frameSize += sizeOfType(obj->varAttrs.type);
       break;
     case OBJ_PARAMETER:
-      obj->paramAttrs->scope = symtab->currentScope;
-      obj->paramAttrs->localOffset = symtab->currentScope->frameSize;
+      obj->paramAttrs.scope = symtab->currentScope;
+      obj->paramAttrs.localOffset = symtab->currentScope->frameSize;
       symtab->currentScope->frameSize ++;
       owner = symtab->currentScope->owner;
       switch (owner->kind) {
       case OBJ_FUNCTION:
-	addObject(&(owner->funcAttrs->paramList), obj);
-	owner->funcAttrs->paramCount ++;
+	addObject(&(owner->funcAttrs.paramList), obj);
+	owner->funcAttrs.paramCount ++;
 	break;
       case OBJ_PROCEDURE:
-	addObject(&(owner->procAttrs->paramList), obj);
-	owner->procAttrs->paramCount ++;
+	addObject(&(owner->procAttrs.paramList), obj);
+	owner->procAttrs.paramCount ++;
 	break;
       default:
 	break;
       }
       break;
     case OBJ_FUNCTION:
-      obj->funcAttrs->scope->outer = symtab->currentScope;
+      obj->funcAttrs.scope->outer = symtab->currentScope;
       break;
     case OBJ_PROCEDURE:
-      obj->procAttrs->scope->outer = symtab->currentScope;
+      obj->procAttrs.scope->outer = symtab->currentScope;
       break;
     default: break;
     }
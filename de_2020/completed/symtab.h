@@ -109,16 +109,16 @@ typedef struct ProgramAttributes_ ProgramAttributes;
 typedef struct ParameterAttributes_ ParameterAttributes;
 
 struct Object_ {
-  char name[MAX_IDENT_LEN];
+  char* name;                   // interned, compare with ==
   enum ObjectKind kind;
   union {
-    ConstantAttributes* constAttrs;
-    VariableAttributes* varAttrs;
-    TypeAttributes* typeAttrs;
-    FunctionAttributes* funcAttrs;
-    ProcedureAttributes* procAttrs;
-    ProgramAttributes* progAttrs;
-    ParameterAttributes* paramAttrs;
+    ConstantAttributes constAttrs;
+    VariableAttributes varAttrs;
+    TypeAttributes typeAttrs;
+    FunctionAttributes funcAttrs;
+    ProcedureAttributes procAttrs;
+    ProgramAttributes progAttrs;
+    ParameterAttributes paramAttrs;
   };
 };
 
@@ -151,9 +151,7 @@ typedef struct SymTab_ SymTab;
 Type* makeIntType(void);
 Type* makeCharType(void);
 Type* makeArrayType(int arraySize, Type* elementType);
-Type* duplicateType(Type* type);
 int compareType(Type* type1, Type* type2);
-void freeType(Type* type);
 int sizeOfType(Type* type);
 
 ConstantValue* makeIntConstant(int i);
@@ -169,8 +167,10 @@ Object* createVariableObject(char *name);
 Object* createFunctionObject(char *name);
 Object* createProcedureObject(char *name);
 Object* createParameterObject(char *name, enum ParamKind kind);
+Object* createTemporaryObject(Scope* scope, Type* type);
 
 Object* findObject(ObjectNode *objList, char *name);
+void addObject(ObjectNode **objList, Object* obj);
 
 void initSymTab(void);
 void cleanSymTab(void);
@@ -4,8 +4,7 @@
  * @version 1.0
  */
 
-#include <stdlib.h>
-#include <ctype.h>
+#include "charcode.h"
 #include "token.h"
 
 struct {
@@ -34,28 +33,31 @@ struct {
   {"TO", KW_TO}
 };
 
-int keywordEq(char *kw, char *string) {
-  while ((*kw != '\0') && (*string != '\0')) {
-    if (*kw != *string) break;
-    kw ++; string ++;
-  }
-  return ((*kw == '\0') && (*string == '\0'));
-}
+// Perfect hash over the keyword set: every keyword lands in its own slot of
+// keywordSlots, which holds its index in keywords[] (-1 for an empty slot).
+// Regenerate the table whenever a keyword is added. The lexeme is taken
+// straight from the source, so case is folded while hashing and comparing.
+#define KEYWORD_SLOTS 64
+#define KEYWORD_HASH(string, length) \
+  ((TO_UPPER((string)[0]) + 2 * TO_UPPER((string)[(length) - 1]) + 7 * (length)) & (KEYWORD_SLOTS - 1))
 
-TokenType checkKeyword(char *string) {
-  int i;
-  for (i = 0; i < KEYWORDS_COUNT; i++)
-    if (keywordEq(keywords[i].string, string)) 
-      return keywords[i].tokenType;
-  return TK_NONE;
-}
+signed char keywordSlots[KEYWORD_SLOTS] = {
+  19, 10, -1,  5, 16, -1, -1, -1, -1, -1, -1, -1, 14, -1,  1,  3,
+  -1, -1, -1, -1, -1, -1,  6, -1, -1,  9,  8,  0, -1, -1,  4, -1,
+  -1, -1, 11, 13, -1, -1, -1, -1, -1,  7, -1, 15, -1, -1, -1, -1,
+  17, -1, -1, -1, -1, -1, -1, 12, -1, -1,  2, -1, -1, -1, -1, 18
+};
+
+TokenType checkKeyword(char *string, int length) {
+  int i = keywordSlots[KEYWORD_HASH(string, length)];
+  char *kw;
+  int j;
 
-Token* makeToken(TokenType tokenType, int lineNo, int colNo) {
-  Token *token = (Token*)malloc(sizeof(Token));
-  token->tokenType = tokenType;
-  token->lineNo = lineNo;
-  token->colNo = colNo;
-  return token;
+  if (i < 0) return TK_NONE;
+  kw = keywords[i].string;
+  for (j = 0; j < length; j ++)
+    if (kw[j] != TO_UPPER(string[j])) return TK_NONE;
+  return (kw[length] == '\0') ? keywords[i].tokenType : TK_NONE;
 }
 
 char *tokenToString(TokenType tokenType) {
@@ -27,14 +27,13 @@ SB_POWER, // đề 2020 bài 1: phép toán lấy mũ **
 } TokenType; 
 
 typedef struct {
-  char string[MAX_IDENT_LEN + 1];
-  int lineNo, colNo;
+  char* string;                 // interned lexeme, see strpool.h
+  int offset, length;           // where the lexeme lies in the source buffer
   TokenType tokenType;
   int value;
 } Token;
 
-TokenType checkKeyword(char *string);
-Token* makeToken(TokenType tokenType, int lineNo, int colNo);
+TokenType checkKeyword(char *string, int length);
 char *tokenToString(TokenType tokenType);
 
 
@@ -9,6 +9,10 @@
 #include <string.h>
 
 #include "vm.h"
+#include "reader.h"
+#include "parser.h"
+#include "cache.h"
+#include "optimize.h"
 #define DEFAULT_STACK_SIZE 2048
 #define DEFAULT_CODE_SIZE 1024
 
@@ -17,13 +21,17 @@ extern int stackSize;
 extern int codeSize;
 
 int dumpCode;
+char *cacheDir = NULL;
+int optimizeLevel = DEFAULT_OPTIMIZE_LEVEL;
 
 
 void printUsage(void) {
-  printf("Usage: kplrun input [-s=stack_size] [-c=code_size] [-debug] [-dump]\n");
-  printf("   input: input kpl program\n");
+  printf("Usage: kplrun input [-s=stack_size] [-c=code_size] [-cache=dir] [-O<level>] [-debug] [-dump]\n");
+  printf("   input: input kpl program, or its source (.kpl)\n");
   printf("   -s=stack_size: set the stack size\n");
   printf("   -c=code_size: set the code size\n");
+  printf("   -cache=dir: where executables compiled from sources are kept\n");
+  printf("   -O<level>: optimize a source, 0 for none, 1 for constant folding and peephole (the default) or 2 for inlining and SSA as well\n");
   printf("   -debug: enable code dump\n");
 }
 
@@ -36,6 +44,14 @@ int analyseParam(char* param) {
     codeSize = atoi(param+3);
     return 1;
   }
+  if (strncmp(param, "-cache=", 7) == 0) {
+    cacheDir = param + 7;
+    return 1;
+  }
+  if (strncmp(param, "-O", 2) == 0) {
+    optimizeLevel = atoi(param + 2);
+    return 1;
+  }
   if (strcmp(param, "-debug") == 0) {
     debugMode = 1;
     return 1;
@@ -47,6 +63,64 @@ int analyseParam(char* param) {
   return 0;
 }
 
+int isSource(char *fileName) {
+  int length = strlen(fileName);
+  return (length > 4) && (strcmp(fileName + length - 4, ".kpl") == 0);
+}
+
+// Compiles a source file straight into the VM, with no executable file in
+// between. An executable compiled from the same source before is taken
+// from the executable cache instead, and a fresh one is stored there.
+// Returns 0, once the reason is printed, if there is nothing to run.
+int loadSource(char *fileName) {
+  char key[CACHE_KEY_LENGTH];
+  CompileOptions options;
+  CompileResult* result;
+  char *source;
+  char *path;
+  FILE *f;
+  int length;
+  int i;
+
+  if (cacheDir == NULL)
+    cacheDir = defaultCacheDirectory(1);
+  options.scanInThread = 0;
+  options.optimizeLevel = optimizeLevel;
+  source = fileKey(fileName, &options, key, &length);
+  if (source == NULL) {
+    printf("kplrun: Can\'t read input file!\n");
+    return 0;
+  }
+
+  path = cachedExecutable(cacheDir, key);
+  f = fopen(path, "rb");
+  free(path);
+  if (f != NULL) {
+    i = loadExecutable(f);
+    fclose(f);
+    if (i) {
+      free(source);
+      return 1;
+    }
+  }
+
+  result = compileSource(source, length, &options);
+  free(source);
+  if (result->diagnosticCount > 0) {
+    for (i = 0; i < result->diagnosticCount; i ++)
+      printf("%d-%d:%s\n", result->diagnostics[i].lineNo,
+	     result->diagnostics[i].colNo, result->diagnostics[i].message);
+    freeCompileResult(result);
+    return 0;
+  }
+
+  storeCached(cacheDir, key, result->code);
+  loadCodeBlock(result->code);
+  result->code = NULL;
+  freeCompileResult(result);
+  return 1;
+}
+
 /******************************************************************/
 
 int main(int argc, char *argv[]) {
@@ -70,21 +144,29 @@ int main(int argc, char *argv[]) {
       return -1;
     }
 
-  f = fopen(argv[1],"r");
+  if (isSource(argv[1])) {
+    initVM();
+    if (loadSource(argv[1]) == 0) {
+      cleanVM();
+      return -1;
+    }
+  } else {
+    f = fopen(argv[1],"r");
 	    
-  if (f == NULL) {
-    printf("kplrun: Can\'t read input file!\n");
-    return -1;
-  }
+    if (f == NULL) {
+      printf("kplrun: Can\'t read input file!\n");
+      return -1;
+    }
 
-  initVM();
-  if (loadExecutable(f) == 0) {
-    printf("kplrun: Wrong executable format!\n");
+    initVM();
+    if (loadExecutable(f) == 0) {
+      printf("kplrun: Wrong executable format!\n");
+      fclose(f);
+      cleanVM();
+      return -1;
+    }
     fclose(f);
-    cleanVM();
-    return -1;
   }
-  fclose(f);
 
   if (dumpCode) {
     printCodeBuffer();
@@ -43,12 +43,32 @@ void cleanVM(void) {
   free(stack);
 }
 
+// The code buffer grows to hold the whole executable if need be
 int loadExecutable(FILE* f) {
+  long start = ftell(f);
+  long end;
+
+  if ((start >= 0) && (fseek(f, 0, SEEK_END) == 0) && ((end = ftell(f)) >= 0)) {
+    fseek(f, start, SEEK_SET);
+    if ((end - start) / (long) sizeof(Instruction) >= codeBlock->maxSize) {
+      freeCodeBlock(codeBlock);
+      codeBlock = createCodeBlock((end - start) / sizeof(Instruction) + 1);
+    }
+  }
   loadCode(codeBlock,f);
   resetVM();
   return 1;
 }
 
+// Runs code compiled in this process. The VM takes the block over and
+// frees it in cleanVM.
+int loadCodeBlock(CodeBlock* block) {
+  freeCodeBlock(codeBlock);
+  codeBlock = block;
+  resetVM();
+  return 1;
+}
+
 int saveExecutable(FILE* f) {
   saveCode(codeBlock,f);
   return 1;
@@ -288,6 +308,29 @@ int run(void) {
       else stack[t] = FALSE;
       checkStack();
       break;
+    case OP_FORPREP:
+      // The variable's address is on the top, the bound in the frame
+      if (stack[stack[t]] > stack[b + code[pc].p]) {
+	pc = code[pc].q - 1;
+	t --;
+	checkStack();
+      }
+      break;
+    case OP_FORLOOP:
+      stack[stack[t]] ++;
+      if (stack[stack[t]] <= stack[b + code[pc].p])
+	pc = code[pc].q - 1;
+      else {
+	t --;
+	checkStack();
+      }
+      break;
+    case OP_TJ:
+      if (stack[t] != FALSE)
+	pc = code[pc].q - 1;
+      t --;
+      checkStack();
+      break;
     case OP_BP:
       // Just for debugging
       debugMode = 1;
@@ -26,6 +26,7 @@ void initVM(void);
 void cleanVM(void);
 
 int loadExecutable(FILE* f);
+int loadCodeBlock(CodeBlock* block);
 int saveExecutable(FILE* f);
 
 int run(void);